@@ -49,30 +49,24 @@ then
     cd ..
 fi
 
-ask "Would you like to generate unigrams?"
+ask "Would you like to generate unigrams, bigrams and trigrams?"
 if [ "$ans" = y ];
 then
     cd bin
-    pv ../data/wikipedia/clean/tokenized.txt | ngrams -m 500M -n 1 | ascii2uni > \
-        ../data/wikipedia/ngrams/unigrams-unsorted.txt
-    cd ..
-fi
-
-ask "Would you like to generate bigrams?"
-if [ "$ans" = y ];
-then
-    cd bin
-    pv ../data/wikipedia/clean/tokenized.txt | ngrams -m 500M -n 2 | ascii2uni > \
-        ../data/wikipedia/ngrams/bigrams-unsorted.txt
-    cd ..
-fi
-
-ask "Would you like to generate trigrams?"
-if [ "$ans" = y ];
-then
-    cd bin
-    pv ../data/wikipedia/clean/tokenized.txt | ngrams -m 500M -n 3 | ascii2uni > \
-        ../data/wikipedia/ngrams/trigrams-unsorted.txt
+    # all three orders are counted in a single pass over the input
+    pv ../data/wikipedia/clean/tokenized.txt | ngrams -m 500M -n 1-3 \
+        -o ../data/wikipedia/ngrams/counts
+    for n in 1 2 3;
+    do
+        case $n in
+            1) name=unigrams ;;
+            2) name=bigrams ;;
+            3) name=trigrams ;;
+        esac
+        ascii2uni < ../data/wikipedia/ngrams/counts.$n > \
+            ../data/wikipedia/ngrams/$name-unsorted.txt
+        rm ../data/wikipedia/ngrams/counts.$n
+    done
     cd ..
 fi
 
@@ -0,0 +1,195 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    ZipfCorpus.cpp: generates a synthetic corpus for benchmarks. Words
+                    are drawn from a vocabulary with Zipf-distributed
+                    frequencies: the word of rank r has a probability
+                    proportional to 1/r^s. Words are made up of letters,
+                    with more frequent words being shorter, and
+                    sentences are capitalized and end with a period, so
+                    that the corpus can be tokenized like real text.
+                    The output only depends on the options and the
+                    seed.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "LineIO.h"
+#include "utilities.h"
+
+using namespace std;
+
+/// Spells out the word of rank r: a, b, ..., z, aa, ab, ...
+string wordOf(size_t rank)
+{
+  string word;
+  rank++;
+  while(rank > 0) {
+    rank--;
+    word.push_back('a' + rank % 26);
+    rank /= 26;
+  }
+  reverse(word.begin(), word.end());
+  return word;
+}
+
+/// Draws word ranks with Zipf-distributed probabilities
+class ZipfDistribution
+{
+ private:
+  vector<double> cumulative; // probability of ranks up to and including r
+
+ public:
+  ZipfDistribution(size_t vocabularySize, double exponent)
+  {
+    double sum = 0;
+    this->cumulative.resize(vocabularySize);
+    for(size_t r=0; r<vocabularySize; r++) {
+      sum += 1.0 / pow(r+1, exponent);
+      this->cumulative[r] = sum;
+    }
+    for(size_t r=0; r<vocabularySize; r++)
+      this->cumulative[r] /= sum;
+  }
+
+  template<class Random>
+  size_t operator() (Random& random) const
+  {
+    double p = uniform_real_distribution<double>(0, 1)(random);
+    size_t rank = lower_bound(cumulative.begin(), cumulative.end(), p) - cumulative.begin();
+    return min(rank, cumulative.size() - 1);
+  }
+};
+
+/// Parses a size such as 64m. Returns -1 on errors.
+long parseSize(const char* str)
+{
+  long size = -1;
+  char unit = '\0';
+  if(sscanf(str, "%ld%c", &size, &unit) < 1)
+    return -1;
+
+  switch(tolower(unit)) {
+  case 'k':
+    return size*1024;
+  case 'm':
+    return size*1024*1024;
+  case 'g':
+    return size*1024*1024*1024;
+  case '\0':
+    return size;
+  default:
+    return -1;
+  }
+}
+
+void printUsage(const char* name)
+{
+  printf("Usage: %s [-s SIZE] [-w WORDS] [-e EXPONENT] [-l MIN-MAX] [-p SENTENCES] [--seed SEED]\n", name);
+}
+
+int main(int argc, const char** argv)
+{
+  long size = 64*1024*1024;
+  long vocabularySize = 100000;
+  double exponent = 1.0;
+  long minLength = 5, maxLength = 30;
+  long paragraphLength = 5;
+  unsigned long seed = 1;
+
+  for(int i=1; i<argc; i++) {
+    bool more = i < argc-1;
+    if(strcmp("-s", argv[i]) == 0 && more) {
+      size = parseSize(argv[++i]);
+    }
+    else if(strcmp("-w", argv[i]) == 0 && more) {
+      vocabularySize = atol(argv[++i]);
+    }
+    else if(strcmp("-e", argv[i]) == 0 && more) {
+      exponent = atof(argv[++i]);
+    }
+    else if(strcmp("-l", argv[i]) == 0 && more) {
+      if(!parseRange(argv[++i], minLength, maxLength))
+        minLength = maxLength = 0; // rejected below
+    }
+    else if(strcmp("-p", argv[i]) == 0 && more) {
+      paragraphLength = atol(argv[++i]);
+    }
+    else if(strcmp("--seed", argv[i]) == 0 && more) {
+      seed = strtoul(argv[++i], NULL, 10);
+    }
+    else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(size < 0 || vocabularySize <= 0 || exponent <= 0 || minLength <= 0
+     || maxLength < minLength || paragraphLength < 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  vector<string> words(vocabularySize);
+  for(long r=0; r<vocabularySize; r++)
+    words[r] = wordOf(r);
+
+  ZipfDistribution zipf(vocabularySize, exponent);
+  mt19937_64 random(seed);
+  uniform_int_distribution<int> sentenceLength(minLength, maxLength);
+
+  // sentences are separated by newlines, and paragraphs (which
+  // collocations splits its input at) by blank lines
+  try {
+    LineWriter out(stdout);
+    string sentence;
+    long written = 0;
+    for(long s=1; written < size; s++) {
+      sentence.clear();
+      const int length = sentenceLength(random);
+      for(int i=0; i<length; i++) {
+        if(i > 0)
+          sentence.push_back(' ');
+        sentence.append(words[zipf(random)]);
+      }
+      sentence[0] = toupper(sentence[0]);
+      sentence.append(".\n");
+      if(paragraphLength > 0 && s % paragraphLength == 0)
+        sentence.push_back('\n');
+
+      out.write(sentence);
+      written += sentence.size();
+    }
+    out.flush();
+  } catch(string err) {
+    cerr << err << endl;
+    return 1;
+  }
+  return 0;
+}
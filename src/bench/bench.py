@@ -0,0 +1,220 @@
+#!/usr/bin/env python
+
+"""
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    bench.py: times Autocorpus tools on synthetic corpora of several
+              sizes (see ZipfCorpus.cpp), and writes the throughput,
+              peak memory and temporary disk usage of each tool to a
+              JSON file, so that results of different versions can be
+              compared.
+
+              Temporary files are unlinked as soon as they're created,
+              so their size is estimated from the free space of the
+              temporary directory's file system, sampled while a tool
+              runs. Other processes writing to the same file system
+              skew the estimate.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+"""
+
+from __future__ import print_function
+
+import os
+import sys
+import json
+import time
+import shutil
+import platform
+import tempfile
+import subprocess
+from optparse import OptionParser
+
+def parseSize(size):
+    multipliers = {'k': 1024, 'm': 1024**2, 'g': 1024**3}
+    size = size.strip().lower()
+    if size[-1] in multipliers:
+        return int(size[:-1]) * multipliers[size[-1]]
+    return int(size)
+
+def usedBytes(path):
+    info = os.statvfs(path)
+    return (info.f_blocks - info.f_bfree) * info.f_frsize
+
+def countLines(path):
+    lines = 0
+    with open(path, 'rb') as f:
+        while True:
+            block = f.read(1024*1024)
+            if not block:
+                break
+            lines += block.count(b'\n')
+    return lines
+
+def run(command, inputs, stdin, stdout, tmpDir):
+    """Runs a command with stdin and stdout redirected to files, and
+    returns its wall time, peak RSS (kB) and estimated temporary
+    bytes. inputs are all files the command reads."""
+    print("> " + " ".join(command), file=sys.stderr)
+    inFile = open(stdin, 'rb') if stdin else None
+    outFile = open(stdout, 'wb')
+    usedBefore = usedBytes(tmpDir)
+    peakUsed = 0
+
+    start = time.time()
+    process = subprocess.Popen(command, stdin=inFile, stdout=outFile)
+    while True:
+        pid, status, usage = os.wait4(process.pid, os.WNOHANG)
+        if pid != 0:
+            break
+        peakUsed = max(peakUsed, usedBytes(tmpDir) - usedBefore)
+        time.sleep(0.05)
+    seconds = time.time() - start
+
+    outFile.close()
+    if inFile:
+        inFile.close()
+    if status != 0:
+        raise Exception("%s failed with status %d" % (command[0], status))
+
+    # whatever is still in use at the end is output, not temporary
+    tempBytes = max(0, peakUsed - (usedBytes(tmpDir) - usedBefore))
+    inputBytes = sum(os.path.getsize(path) for path in inputs)
+    inputLines = sum(countLines(path) for path in inputs)
+    return {
+        "seconds": seconds,
+        "input_bytes": inputBytes,
+        "input_lines": inputLines,
+        "mb_per_s": inputBytes / 1024.0**2 / max(seconds, 1e-6),
+        "lines_per_s": inputLines / max(seconds, 1e-6),
+        "peak_rss_kb": usage.ru_maxrss,
+        "temp_bytes": tempBytes,
+    }
+
+def countHalves(corpus, outputs, memory):
+    """Writes the bigram counts of the first and the second half of
+    the lines of a corpus to two files, to be merged by merge-counts.
+    Isn't timed."""
+    lines = countLines(corpus)
+    with open(corpus, 'rb') as f:
+        for half, output in enumerate(outputs):
+            with open(output, 'wb') as out:
+                tokenize = subprocess.Popen(["tokenize"], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+                ngrams = subprocess.Popen(["ngrams", "-n", "2", "-m", memory],
+                                          stdin=tokenize.stdout, stdout=out)
+                tokenize.stdout.close()
+                for i in range(lines // 2 if half == 0 else lines - lines // 2):
+                    tokenize.stdin.write(f.readline())
+                tokenize.stdin.close()
+                if tokenize.wait() != 0 or ngrams.wait() != 0:
+                    raise Exception("Could not count the bigrams of %s" % corpus)
+
+def benchmark(size, options, workDir):
+    """Generates a corpus of the given size, and runs each tool on it
+    or on the output of a previous tool"""
+    def path(name):
+        return os.path.join(workDir, name)
+
+    print("Generating a %d byte corpus..." % size, file=sys.stderr)
+    with open(path("corpus.txt"), 'wb') as out:
+        subprocess.check_call([options.generator, "-s", str(size), "-w", str(options.words),
+                               "-e", str(options.exponent), "-p", str(options.paragraph),
+                               "--seed", str(options.seed)],
+                              stdout=out)
+
+    tmpDir = tempfile.gettempdir()
+    memory = options.memory
+    countHalves(path("corpus.txt"), [path("half.1.2"), path("half.2.2")], memory)
+    steps = [
+        ("tokenize", ["tokenize"], ["corpus.txt"], "corpus.txt", "tokenized.txt"),
+        ("ngrams -n 1", ["ngrams", "-n", "1", "-m", memory], ["tokenized.txt"], "tokenized.txt", "counts.1"),
+        ("ngrams -n 2", ["ngrams", "-n", "2", "-m", memory], ["tokenized.txt"], "tokenized.txt", "counts.2"),
+        ("ngrams -n 3", ["ngrams", "-n", "3", "-m", memory], ["tokenized.txt"], "tokenized.txt", "counts.3"),
+        ("ngrams-freq-filter", ["ngrams-freq-filter", "-t", "2"], ["counts.2"], "counts.2", "filtered.2"),
+        ("ngrams-sort", ["ngrams-sort", "-m", memory], ["counts.2"], "counts.2", "sorted.2"),
+        ("merge-counts", ["merge-counts", path("half.1.2"), path("half.2.2")],
+         ["half.1.2", "half.2.2"], None, "merged.2"),
+        ("collocations", ["collocations", "-m", memory, path("tokenized.txt")],
+         ["tokenized.txt"], None, "collocations.txt"),
+        ("mutual-information", ["mutual-information", "--unigrams", path("counts.1")],
+         ["collocations.txt", "counts.1"], "collocations.txt", "mi.txt"),
+    ]
+
+    results = []
+    for name, command, inputs, stdin, stdout in steps:
+        result = run(command, [path(f) for f in inputs], stdin and path(stdin),
+                     path(stdout), tmpDir)
+        result["tool"] = name
+        result["command"] = " ".join(command)
+        result["corpus_bytes"] = size
+        results.append(result)
+        print("  %-20s %8.2fs %8.2f MB/s %10.0f lines/s %8d kB RSS %12d temp bytes" %
+              (name, result["seconds"], result["mb_per_s"], result["lines_per_s"],
+               result["peak_rss_kb"], result["temp_bytes"]), file=sys.stderr)
+    return results
+
+if __name__ == "__main__":
+    parser = OptionParser(usage="%prog [options]")
+    parser.add_option("--sizes", default="4m,16m",
+                      help="comma-separated corpus sizes, with optional k, m or g suffixes")
+    parser.add_option("--out", default="results.json", help="results file")
+    parser.add_option("--generator", default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                          "zipf-corpus"),
+                      help="path to the zipf-corpus generator")
+    parser.add_option("--words", type="int", default=100000, help="vocabulary size")
+    parser.add_option("--exponent", type="float", default=1.0, help="Zipf exponent")
+    parser.add_option("--paragraph", type="int", default=5,
+                      help="sentences per paragraph. collocations counts all pairs of words of a paragraph.")
+    parser.add_option("--seed", type="int", default=1)
+    parser.add_option("--memory", default="256m", help="memory limit passed to the tools")
+    parser.add_option("--work-dir", dest="workDir", default=None,
+                      help="where corpora and outputs are kept (default: a temporary directory)")
+    (options, args) = parser.parse_args()
+
+    if len(args) != 0:
+        parser.print_usage()
+        sys.exit(1)
+
+    workDir = tempfile.mkdtemp(prefix="autocorpus-bench-", dir=options.workDir)
+    results = []
+    try:
+        for size in options.sizes.split(","):
+            results += benchmark(parseSize(size), options, workDir)
+    except Exception as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        sys.exit(1)
+    finally:
+        shutil.rmtree(workDir)
+
+    report = {
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "host": platform.node(),
+        "cpus": os.sysconf("SC_NPROCESSORS_ONLN"),
+        "words": options.words,
+        "exponent": options.exponent,
+        "paragraph": options.paragraph,
+        "seed": options.seed,
+        "memory": options.memory,
+        "results": results,
+    }
+    with open(options.out, 'w') as out:
+        json.dump(report, out, indent=2, sort_keys=True)
+        out.write("\n")
+    print("Results written to " + options.out, file=sys.stderr)
@@ -34,11 +34,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <math.h>
 #include <time.h>
 
 #include "utilities.h"
 #include "merge.h"
+#include "ChunkFile.h"
+#include "LineIO.h"
 
 using namespace std;
 using namespace boost;
@@ -48,6 +51,7 @@ const size_t buf_size = 1024*1024;
 struct {
   string filePath;
   bool verbose;
+  bool compress; // compress intermediate files
   size_t splitSize;
   unsigned int numSplitThreads;
   unsigned int numMergeThreads;
@@ -61,7 +65,7 @@ struct {
   size_t mergesScheduled;
   size_t mergesComplete;
   timespec startTime;
-  mutex mtx;
+  boost::mutex mtx;
 
   bool splitsDone()
   {
@@ -149,15 +153,14 @@ bool operator < (const MergeRequest& mr1, const MergeRequest& mr2)
 }
 
 
+/// Converts a chunk file to the text format
 void copyStream(FILE* in, FILE* out)
 {
-  const size_t buf_size = 10*1024*1024;
-  char* buf = new char[buf_size];
-  while(!feof(in)) {
-    size_t count = fread(buf, 1, buf_size, in);
-    fwrite(buf, 1, count, out);
-  }
-  delete[] buf;
+  ChunkReader reader(in);
+  TextCountWriter writer(out);
+  while(reader.next())
+    writer.write(reader.key(), reader.keyLength(), reader.count());
+  writer.close();
 }
 
 double fileSizeGB(FILE* f)
@@ -282,13 +285,18 @@ void paragraphCounts(unordered_map<string, unordered_map<string, long>>& ht,
 /// temporary file, whose handle is returned.
 FILE* splitCounts(const char* filePath, FileSplit split)
 {
-  ifstream file(filePath);
-  file.seekg(split.start);
+  int fd = open(filePath, O_RDONLY);
+  if(fd < 0)
+    throw string("Could not open ") + filePath;
+  lseek(fd, split.start, SEEK_SET);
+
+  LineReader file(fd);
   vector<string> paragraph;
   unordered_map<string, unordered_map<string, long>> ht;
   string line;
-  while(file.good() && (size_t)file.tellg() < split.end) {
-    getline(file, line);
+  size_t pos = split.start;
+  while(pos < split.end && file.next(line)) {
+    pos += line.length() + 1;
     if(line == "") {
       // end of paragraph
       paragraphCounts(ht, paragraph);
@@ -304,7 +312,7 @@ FILE* splitCounts(const char* filePath, FileSplit split)
   }
 
   paragraphCounts(ht, paragraph);  
-  file.close();
+  close(fd);
 
   vector<CountPair> counts;
   size_t i = 0;
@@ -321,9 +329,13 @@ FILE* splitCounts(const char* filePath, FileSplit split)
   sort(counts.begin(), counts.end());
 
   FILE* out = tmpfile();
+  ChunkWriter writer(out, options.compress);
+  string key;
   for(auto cp : counts) {
-    fprintf(out, "%ld%c%s %s\n", cp.count, COUNT_SEPARATOR, cp.w.c_str(), cp.v.c_str());
+    key = cp.w + " " + cp.v;
+    writer.write(key.data(), key.size(), cp.count);
   }
+  writer.close();
   rewind(out);
 
   reportSplitDone(out);
@@ -406,11 +418,11 @@ void splitFile(FILE* f, size_t maxSize, vector<FileSplit>& splits)
 
 /// Stores pending counting tasks for splits
 queue<FileSplit> splitQueue;
-mutex splitMutex;
+boost::mutex splitMutex;
 
 /// Stores pending merge counts
 priority_queue<MergeRequest, vector<MergeRequest>, greater<MergeRequest>> mergeQueue;
-mutex mergeMutex;
+boost::mutex mergeMutex;
 
 /// Gets next available file split and removed it from the queue.
 /// Thread-safe.
@@ -491,7 +503,10 @@ void mergeTask()
     if(claimMerge(f1, f2)) {
       // we got a merge task!
       FILE* out = tmpfile();
-      mergeCounts(f1, f2, out);
+      vector<FILE*> sources;
+      sources.push_back(f1);
+      sources.push_back(f2);
+      mergeChunkFiles(sources, out, options.compress);
       reportMergeDone(out);
       fclose(f1);
       fclose(f2);
@@ -577,13 +592,14 @@ int countCollocations()
 
 void printUsage(const char* name)
 {
-  printf("Usage: %s [-m LIMIT] [-v] [-t THREADS] file\n", name);
+  printf("Usage: %s [-m LIMIT] [-v] [-z] [-ts THREADS] [-tm THREADS] [-ms SPLITS] file\n", name);
 }
 
 int main(int argc, char* argv[])
 {
   // Default options
   options.verbose = false;
+  options.compress = false;
   options.splitSize = 1*1024*1024;
   options.numSplitThreads = 1;
   options.numMergeThreads = 1;
@@ -593,38 +609,18 @@ int main(int argc, char* argv[])
   vector<string> unparsedOpts;
   for(int i=1; i<argc; i++) {
     if(strcmp("-m", argv[i]) == 0 && i<argc-1) {
-      long multiplier = 1;
-      char unit = '\0';
-      sscanf(argv[i+1], "%ld%c", &options.splitSize, &unit);
-      unit = tolower(unit);
-
-      switch(unit) {
-      case 'b':
-        multiplier = 512;
-        break;
-      case 'k':
-        multiplier = 1024;
-        break;
-      case 'm':
-        multiplier = 1024*1024;
-        break;
-      case 'g':
-        multiplier = 1024*1024*1024;
-        break;
-      case'\0':
-        multiplier = 1;
-        break;
-      default:
+      if(!parseSize(argv[i+1], options.splitSize)) {
         printUsage(argv[0]);
         return 1;
       }
-      
-      options.splitSize *= multiplier;
       i++;
     }
     else if(strcmp("-v", argv[i]) == 0) {
       options.verbose = true;
     }
+    else if(strcmp("-z", argv[i]) == 0) {
+      options.compress = true;
+    }
     else if(strcmp("-ts", argv[i]) == 0) {
       sscanf(argv[i+1], "%d", &options.numSplitThreads);
       i++;
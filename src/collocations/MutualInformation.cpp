@@ -1,13 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include <iostream>
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
 #include <unordered_map>
 
 #include "utilities.h"
+#include "LineIO.h"
+#include "CountStream.h"
+#include "IndexedFile.h"
 
 using namespace std;
 
@@ -22,41 +27,72 @@ struct
   long countCutoff;
 } options;
 
+/// Loads unigrams in the indexed format, whose footer has the total
+/// and the number of unigrams
+bool loadIndexedUnigrams(FILE* file, unordered_map<string, long>& ht, long& total)
+{
+  try {
+    IndexedReader reader(file);
+    total = reader.total();
+    ht.reserve(reader.keys());
+    while(reader.next())
+      ht[string(reader.key(), reader.keyLength())] += reader.count();
+  } catch(string err) {
+    cerr << err << endl;
+    return false;
+  }
+  cerr << "ok. " << ht.size() << " unique." << endl;
+  return true;
+}
+
 bool loadUnigrams(unordered_map<string, long>& ht, long& total)
 {
   cerr << "Loading unigrams... ";
+  FILE* indexed = fopen(options.unigramsPath, "rb");
+  if(indexed != NULL && IndexedReader::isIndexed(indexed)) {
+    bool loaded = loadIndexedUnigrams(indexed, ht, total);
+    fclose(indexed);
+    return loaded;
+  }
+  if(indexed != NULL)
+    fclose(indexed);
+
   string line;
   long count;
-  char ngram[1024*1024];
-  ifstream file(options.unigramsPath);
+  int fd = open(options.unigramsPath, O_RDONLY);
 
-  if(!file.good()) {
+  if(fd < 0) {
     fprintf(stderr, "Error reading file %s\n", options.unigramsPath);
     return false;
   }
 
-  getline(file, line);
+  LineReader file(fd);
+  file.next(line);
   if(sscanf(line.c_str(), "%ld", &total) < 1) {
     fprintf(stderr, "Could not parse total number of unigrams. Line: %s\n", line.c_str());
-    return 1;
+    close(fd);
+    return false;
   }
 
   long errors = 0;
-  while(!file.eof()) {
-    getline(file, line);
-    if(!deconstructCount(line.c_str(), ngram, &count)) {
+  const char* data;
+  size_t length;
+  const char* ngram;
+  size_t ngramLength;
+  while(file.next(data, length)) {
+    if(!parseCountLine(data, length, count, ngram, ngramLength)) {
       errors++;
       continue;
     }
-    ht[ngram]+=count;
+    ht[string(ngram, ngramLength)] += count;
   }
   cerr << "ok. " << ht.size() << " unique. " << errors << " errors." << endl;
-  file.close();
+  close(fd);
   return true;
 }
 
 void printMI(string& currentWord, unordered_map<string, long>& counts,
-             unordered_map<string, long>& unigrams, long N)
+             unordered_map<string, long>& unigrams, long N, LineWriter& out)
 {
   if(unigrams.count(currentWord) == 0) {
     //cerr << "Warning: unigram '" << currentWord << "' does not exist (w)." << endl;
@@ -90,53 +126,73 @@ void printMI(string& currentWord, unordered_map<string, long>& counts,
   // sort by decreasing MI
   sort(vs.begin(), vs.end(), 
        [&](const string& a, const string& b) { return mi[a] > mi[b]; });
+  char number[64];
   for(auto v : vs) {
     const double mi_v = mi[v];
-    cout << mi_v/norm << COUNT_SEPARATOR 
-         << mi_v << COUNT_SEPARATOR 
-         << counts[v] << COUNT_SEPARATOR 
-         << currentWord << COUNT_SEPARATOR
-         << v << endl;
+    // %g prints doubles the way cout does by default
+    out.write(number, snprintf(number, sizeof(number), "%g%c%g%c",
+                               mi_v/norm, COUNT_SEPARATOR, mi_v, COUNT_SEPARATOR));
+    out.write(counts[v]);
+    out.put(COUNT_SEPARATOR);
+    out.write(currentWord);
+    out.put(COUNT_SEPARATOR);
+    out.write(v);
+    out.put('\n');
   }
 }
 
+/// Finds the next word between pos and end, skipping any whitespace
+/// before it, and moves pos past it. Returns false if there's none.
+inline bool nextWord(const char*& pos, const char* end, const char*& word, size_t& length)
+{
+  while(pos < end && isspace((unsigned char)*pos))
+    pos++;
+  word = pos;
+  while(pos < end && !isspace((unsigned char)*pos))
+    pos++;
+  length = pos - word;
+  return length > 0;
+}
+
 bool computeMI(unordered_map<string, long>& unigrams, long N)
 {
-  string line;  
   string currentWord;
   unordered_map<string, long> counts;
-  vector<string> keyWords;
-  char key[1024*1024];
-
-  while(cin.good())
+  const char* line;
+  size_t length;
+  const char* key;
+  size_t keyLength;
+  LineReader in(0);
+  LineWriter out(stdout);
+
+  while(in.next(line, length))
   {
-    getline(cin, line);
     long c;
-    if(!deconstructCount(line.c_str(), key, &c)) {
-      //fprintf(stderr, "\nWarning: could not parse count for line: %s\n", line.c_str());
+    if(!parseCountLine(line, length, c, key, keyLength))
       continue;
-    }
 
-    keyWords.clear();
-    words(key, keyWords);
-    if(keyWords.size() != 2) {
-      //cerr << "Warning: invalid number of words ("
-      //     << keyWords.size() << ", expected 2): " << key << endl;
+    // keys are pairs of words, w v, separated by whitespace
+    const char* pos = key;
+    const char* keyEnd = key + keyLength;
+    const char *w, *v, *extra;
+    size_t wLength, vLength, extraLength;
+    if(!nextWord(pos, keyEnd, w, wLength) || !nextWord(pos, keyEnd, v, vLength)
+       || nextWord(pos, keyEnd, extra, extraLength))
       continue;
-    }
 
-    if(keyWords[0] != currentWord) {
+    if(wLength != currentWord.size() || memcmp(w, currentWord.data(), wLength) != 0) {
       if(currentWord != "")
-        printMI(currentWord, counts, unigrams, N);
+        printMI(currentWord, counts, unigrams, N, out);
       counts.clear();
-      currentWord = keyWords[0];      
+      currentWord.assign(w, wLength);
     }
 
-    counts[keyWords[1]] = c;
+    counts[string(v, vLength)] = c;
   }
 
   if(currentWord != "" && counts.size() > 0)
-    printMI(currentWord, counts, unigrams, N);
+    printMI(currentWord, counts, unigrams, N, out);
+  out.flush();
   return true;
 }
 
@@ -179,5 +235,5 @@ int main(int argc, char** argv)
     return 1;
   }
   
-  return computeMI(unigrams, unigramsTotal);
+  return computeMI(unigrams, unigramsTotal) ? 0 : 1;
 }
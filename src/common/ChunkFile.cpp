@@ -0,0 +1,184 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    ChunkFile.cpp: the binary format of intermediate (chunk) files. Chunks
+                   are only ever read by the tools which wrote them, so
+                   unlike the text format they are optimized for size
+                   and parsing speed:
+
+                     block  := records(uint32) length(uint32)
+                               stored(uint32) data
+                     data   := record*, zlib-compressed unless
+                               stored == length
+                     record := shared(varint) suffix(varint)
+                               suffix bytes, count(varint)
+
+                   Keys are sorted and front-coded: each key only stores
+                   the suffix it doesn't share with the previous key.
+                   Front coding restarts at every block (~64KB), so
+                   blocks can be decoded independently. Writers may
+                   compress blocks with zlib's fastest level to save
+                   disk space and bandwidth; readers handle both.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <zlib.h>
+#include "ChunkFile.h"
+
+using namespace std;
+
+const size_t BLOCK_SIZE = 64*1024;
+const size_t HEADER_SIZE = 12;
+
+ChunkWriter::ChunkWriter(FILE* file, bool compress) {
+  this->file = file;
+  this->compress = compress;
+  this->records = 0;
+  this->written = 0;
+}
+
+void ChunkWriter::write(const char* key, size_t length, long count)
+{
+  // the first key of a block is stored in full
+  size_t shared = 0;
+  if(records > 0) {
+    size_t maxShared = min(length, lastKey.size());
+    while(shared < maxShared && lastKey[shared] == key[shared])
+      shared++;
+  }
+
+  putVarint(block, shared);
+  putVarint(block, length - shared);
+  block.append(key + shared, length - shared);
+  putVarint(block, (uint64_t)count);
+  lastKey.assign(key, length);
+  records++;
+
+  if(block.size() >= BLOCK_SIZE)
+    writeBlock();
+}
+
+void ChunkWriter::writeBlock()
+{
+  // blocks which don't shrink are stored as they are
+  const string* data = &block;
+  if(compress) {
+    uLongf length = compressBound(block.size());
+    compressed.resize(length);
+    if(compress2((Bytef*)&compressed[0], &length, (const Bytef*)block.data(),
+                 block.size(), Z_BEST_SPEED) != Z_OK)
+      throw string("Could not compress chunk block.");
+    compressed.resize(length);
+    if(compressed.size() < block.size())
+      data = &compressed;
+  }
+
+  char header[HEADER_SIZE];
+  putUint32(header, records);
+  putUint32(header+4, block.size());
+  putUint32(header+8, data->size());
+  if(fwrite(header, 1, HEADER_SIZE, file) != HEADER_SIZE
+     || fwrite(data->data(), 1, data->size(), file) != data->size())
+    throw string("Could not write chunk file. Out of disk space?");
+  written += HEADER_SIZE + data->size();
+
+  block.clear();
+  records = 0;
+}
+
+void ChunkWriter::close()
+{
+  if(records > 0)
+    writeBlock();
+  if(fflush(file) != 0)
+    throw string("Could not write chunk file. Out of disk space?");
+}
+
+ChunkReader::ChunkReader(FILE* file) {
+  this->file = file;
+  this->pos = 0;
+  this->remaining = 0;
+  this->blocksLeft = -1;
+  this->start = ftello(file);
+}
+
+void ChunkReader::seek(off_t offset, long blocks)
+{
+  if(fseeko(file, offset, SEEK_SET) != 0)
+    throw string("Could not seek in chunk file.");
+  pos = 0;
+  remaining = 0;
+  blocksLeft = blocks;
+}
+
+bool ChunkReader::readBlock()
+{
+  if(blocksLeft == 0)
+    return false;
+  if(blocksLeft > 0)
+    blocksLeft--;
+
+  char header[HEADER_SIZE];
+  size_t cRead = fread(header, 1, HEADER_SIZE, file);
+  if(cRead == 0 && feof(file))
+    return false;
+  if(cRead != HEADER_SIZE)
+    throw string("Corrupt chunk file: truncated block header.");
+
+  remaining = getUint32(header);
+  uLongf length = getUint32(header+4);
+  size_t stored = getUint32(header+8);
+  string& data = (stored == length) ? block : compressed;
+  data.resize(stored);
+  if(fread(&data[0], 1, stored, file) != stored)
+    throw string("Corrupt chunk file: truncated block.");
+
+  if(stored != length) {
+    block.resize(length);
+    if(uncompress((Bytef*)&block[0], &length, (const Bytef*)compressed.data(), stored) != Z_OK
+       || length != block.size())
+      throw string("Corrupt chunk file: invalid compressed block.");
+  }
+  pos = 0;
+  return true;
+}
+
+bool ChunkReader::next()
+{
+  while(remaining == 0) {
+    if(!readBlock())
+      return false;
+  }
+
+  size_t shared = getVarint(block, pos);
+  size_t suffix = getVarint(block, pos);
+  if(shared > keyBuffer.size() || pos + suffix > block.size())
+    throw string("Corrupt chunk file: invalid key.");
+
+  keyBuffer.resize(shared);
+  keyBuffer.append(block, pos, suffix);
+  pos += suffix;
+  currentCount = (long)getVarint(block, pos);
+  currentKey = keyBuffer.data();
+  currentLength = keyBuffer.size();
+  remaining--;
+  return true;
+}
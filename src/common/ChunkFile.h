@@ -0,0 +1,132 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    ChunkFile.h: see ChunkFile.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ChunkFile_h
+#define ChunkFile_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include "CountStream.h"
+
+/* Numbers of chunk files, and of formats built on them (see
+   IndexedFile.cpp). Fixed-size numbers are little-endian. */
+
+inline void putVarint(std::string& out, uint64_t value)
+{
+  while(value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+inline uint64_t getVarint(const std::string& in, size_t& pos)
+{
+  uint64_t value = 0;
+  for(int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+    uint8_t byte = in[pos++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if(byte < 0x80)
+      return value;
+  }
+  throw std::string("Corrupt chunk file: truncated number.");
+}
+
+inline void putUint32(char* out, uint32_t value)
+{
+  for(int i=0; i<4; i++)
+    out[i] = (char)(value >> (8*i));
+}
+
+inline uint32_t getUint32(const char* in)
+{
+  uint32_t value = 0;
+  for(int i=0; i<4; i++)
+    value |= (uint32_t)(uint8_t)in[i] << (8*i);
+  return value;
+}
+
+inline void putUint64(char* out, uint64_t value)
+{
+  putUint32(out, (uint32_t)value);
+  putUint32(out+4, (uint32_t)(value >> 32));
+}
+
+inline uint64_t getUint64(const char* in)
+{
+  return getUint32(in) | (uint64_t)getUint32(in+4) << 32;
+}
+
+/** Writes sorted counts in the binary chunk format. */
+class ChunkWriter : public CountWriter
+{
+ protected:
+  FILE* file;
+  bool compress;
+  std::string block; // records of the block being built
+  size_t records;    // number of records in the block
+  std::string lastKey;
+  std::string compressed;
+  uint64_t written;  // bytes written so far
+
+  virtual void writeBlock();
+
+ public:
+  /** Compresses blocks with zlib if compress is set */
+  ChunkWriter(FILE* file, bool compress = false);
+  void write(const char* key, size_t length, long count);
+  void close();
+};
+
+/** Reads counts written by ChunkWriter. */
+class ChunkReader : public CountReader
+{
+ private:
+  FILE* file;
+  std::string block;
+  std::string compressed;
+  size_t pos;       // position of the next record within block
+  size_t remaining; // records left in block
+  long blocksLeft;  // blocks left to read, or -1 to read until end of file
+  off_t start;      // of the first block
+  std::string keyBuffer;
+
+  bool readBlock();
+
+ public:
+  ChunkReader(FILE* file);
+  bool next();
+
+  /** Continues reading at the block starting at offset, and reads at
+      most blocks blocks from there (or all of them if blocks is
+      -1). */
+  void seek(off_t offset, long blocks = -1);
+
+  /** Continues reading at the block the reader started at */
+  void rewind() { seek(start); }
+};
+
+#endif // ChunkFile_h
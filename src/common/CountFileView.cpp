@@ -0,0 +1,298 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    CountFileView.cpp: random access to sorted count files. The file is
+                       memory-mapped and every stride-th line start is
+                       kept in a sparse index. A lookup binary-searches
+                       the index and then scans at most stride lines,
+                       comparing keys in place, so only the pages on
+                       the search path are ever read from disk.
+
+                       The index can be saved next to the file so that
+                       it's only built once:
+
+                         index  := magic(uint32) stride(uint32)
+                                   size(uint64) mtime(uint64)
+                                   entries(uint64) offset(uint64)*
+
+                       Numbers are little-endian. The size and
+                       modification time are those of the count file,
+                       and an index which doesn't match them is
+                       rebuilt.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include "CountFileView.h"
+#include "ChunkFile.h"
+
+using namespace std;
+
+const uint32_t INDEX_MAGIC = 0x58444941; // "AIDX"
+const size_t INDEX_HEADER_SIZE = 32;
+
+bool CountRangeReader::next()
+{
+  while(pos < end) {
+    const char* newline = (const char*)memchr(pos, '\n', end - pos);
+    const char* line = pos;
+    const size_t length = (newline ? newline : end) - line;
+    pos = newline ? newline + 1 : end;
+
+    if(parseCountLine(line, length, currentCount, currentKey, currentLength))
+      return true;
+    cerr << "WARNING: Could not deconstruct count from line:" << endl;
+    cerr << string(line, length) << endl;
+  }
+  return false;
+}
+
+CountFileView::CountFileView(const string& path, const string& indexPath, size_t stride)
+{
+  this->path = path;
+  this->data = NULL;
+  this->size = 0;
+  this->hasTotal = false;
+  this->total = 0;
+  this->stride = stride > 0 ? stride : 1;
+
+  this->fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw string("Error opening file ") + path;
+
+  struct stat info;
+  if(fstat(fd, &info) != 0) {
+    close(fd);
+    throw string("Could not stat ") + path;
+  }
+  this->size = info.st_size;
+  this->mtime = info.st_mtime;
+
+  if(size > 0) {
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED) {
+      close(fd);
+      throw string("Could not map ") + path + ": " + strerror(errno);
+    }
+    // lookups jump around the file, so read-ahead is mostly wasted
+    madvise(mapped, size, MADV_RANDOM);
+    this->data = (const char*)mapped;
+  }
+
+  // the total is a line with just a number
+  this->first = data;
+  if(size > 0) {
+    const char* end = lineEnd(data);
+    const char* pos = data;
+    if(pos < end && *pos == '-')
+      pos++;
+    const char* digits = pos;
+    while(pos < end && (unsigned char)(*pos - '0') < 10)
+      pos++;
+    if(pos > digits && pos + 1 == end && *pos == '\r')
+      pos++;
+    if(pos > digits && pos == end) {
+      this->hasTotal = true;
+      this->total = strtol(data, NULL, 10);
+      this->first = end < data + size ? end + 1 : end;
+    }
+  }
+
+  try {
+    if(indexPath.empty() || !loadIndex(indexPath)) {
+      buildIndex();
+      if(!indexPath.empty())
+        saveIndex(indexPath);
+    }
+  } catch(string err) {
+    if(data != NULL)
+      munmap((void*)data, size);
+    close(fd);
+    throw;
+  }
+}
+
+CountFileView::~CountFileView()
+{
+  if(data != NULL)
+    munmap((void*)data, size);
+  close(fd);
+}
+
+/// Returns the end of the line starting at line: its newline, or the
+/// end of the file
+const char* CountFileView::lineEnd(const char* line) const
+{
+  const char* newline = (const char*)memchr(line, '\n', data + size - line);
+  return newline ? newline : data + size;
+}
+
+/// Returns the key of the line starting at line. Lines which aren't
+/// counts are taken to be their own keys.
+void CountFileView::keyOf(const char* line, const char*& key, size_t& length) const
+{
+  const char* end = lineEnd(line);
+  long count;
+  if(!parseCountLine(line, end - line, count, key, length)) {
+    key = line;
+    length = end - line;
+  }
+}
+
+/// Returns the first line for whose key pred holds, or the end of the
+/// file if there's none. pred must be false for a (possibly empty)
+/// run of keys and true for all keys after it.
+template<class Predicate>
+const char* CountFileView::firstLine(Predicate pred) const
+{
+  const char* key;
+  size_t length;
+  size_t lo = 0, hi = index.size();
+  while(lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    keyOf(data + index[mid], key, length);
+    if(pred(key, length))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  // the line is between the last indexed line for which pred is false
+  // and the first for which it's true
+  const char* line = lo == 0 ? first : data + index[lo-1];
+  const char* stop = lo == index.size() ? data + size : data + index[lo];
+  while(line < stop) {
+    keyOf(line, key, length);
+    if(pred(key, length))
+      return line;
+    const char* end = lineEnd(line);
+    line = end < data + size ? end + 1 : end;
+  }
+  return stop;
+}
+
+bool CountFileView::lookup(const char* key, size_t length, long& count) const
+{
+  const char* line = firstLine([key, length](const char* k, size_t l) {
+      return compareKeys(k, l, key, length) >= 0;
+    });
+  if(line == data + size)
+    return false;
+
+  const char* found;
+  size_t foundLength;
+  long foundCount;
+  if(!parseCountLine(line, lineEnd(line) - line, foundCount, found, foundLength)
+     || compareKeys(found, foundLength, key, length) != 0)
+    return false;
+  count = foundCount;
+  return true;
+}
+
+CountRangeReader CountFileView::prefixRange(const char* prefix, size_t length) const
+{
+  const char* begin = firstLine([prefix, length](const char* k, size_t l) {
+      return compareKeys(k, l, prefix, length) >= 0;
+    });
+  // keys with the prefix are the smallest keys not less than it
+  const char* end = firstLine([prefix, length](const char* k, size_t l) {
+      return compareKeys(k, l, prefix, length) >= 0
+        && (l < length || memcmp(k, prefix, length) != 0);
+    });
+  return CountRangeReader(begin, end);
+}
+
+void CountFileView::buildIndex()
+{
+  index.clear();
+  const char* end = data + size;
+  size_t lines = 0;
+  for(const char* line = first; line < end; lines++) {
+    if(lines % stride == 0)
+      index.push_back(line - data);
+    const char* newline = (const char*)memchr(line, '\n', end - line);
+    line = newline ? newline + 1 : end;
+  }
+}
+
+/// Loads an index saved by saveIndex(). Returns false if there's none,
+/// or if it's out of date.
+bool CountFileView::loadIndex(const string& indexPath)
+{
+  FILE* file = fopen(indexPath.c_str(), "rb");
+  if(file == NULL)
+    return false;
+
+  char header[INDEX_HEADER_SIZE];
+  bool valid = fread(header, 1, INDEX_HEADER_SIZE, file) == INDEX_HEADER_SIZE
+    && getUint32(header) == INDEX_MAGIC
+    && getUint32(header + 4) == stride
+    && getUint64(header + 8) == size
+    && getUint64(header + 16) == mtime;
+
+  if(valid) {
+    // a corrupt count mustn't make us allocate more than the file
+    // could possibly need
+    const uint64_t entries = getUint64(header + 24);
+    valid = entries <= size / stride + 1;
+    string offsets(valid ? entries * 8 : 0, '\0');
+    valid = valid && fread(&offsets[0], 1, offsets.size(), file) == offsets.size();
+    if(valid) {
+      index.resize(entries);
+      for(size_t i=0; i<entries; i++) {
+        index[i] = getUint64(offsets.data() + 8*i);
+        valid = valid && index[i] < size && index[i] >= (uint64_t)(first - data)
+          && (i == 0 || index[i] > index[i-1]);
+      }
+    }
+  }
+  fclose(file);
+
+  if(!valid)
+    index.clear();
+  return valid;
+}
+
+void CountFileView::saveIndex(const string& indexPath) const
+{
+  string out(INDEX_HEADER_SIZE + 8*index.size(), '\0');
+  putUint32(&out[0], INDEX_MAGIC);
+  putUint32(&out[4], stride);
+  putUint64(&out[8], size);
+  putUint64(&out[16], mtime);
+  putUint64(&out[24], index.size());
+  for(size_t i=0; i<index.size(); i++)
+    putUint64(&out[INDEX_HEADER_SIZE + 8*i], index[i]);
+
+  FILE* file = fopen(indexPath.c_str(), "wb");
+  if(file == NULL)
+    throw string("Error opening index ") + indexPath;
+  const bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+  if(fclose(file) != 0 || !written)
+    throw string("Could not write index ") + indexPath;
+}
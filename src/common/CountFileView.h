@@ -0,0 +1,102 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    CountFileView.h: see CountFileView.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CountFileView_h
+#define CountFileView_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "CountStream.h"
+
+/** Reads the counts of a range of lines of a CountFileView. */
+class CountRangeReader : public CountReader
+{
+ private:
+  const char* pos;
+  const char* end;
+
+ public:
+  CountRangeReader(const char* begin, const char* end) : pos(begin), end(end) { }
+  bool next();
+
+  bool empty() const { return pos == end; }
+};
+
+/** A read-only, memory-mapped view of a count file sorted by key,
+    such as a file in the ngrams(5) format. Keys are looked up with a
+    binary search over a sparse index of line starts. */
+class CountFileView
+{
+ private:
+  std::string path;
+  int fd;
+  const char* data;  // the mapped file
+  size_t size;
+  const char* first; // the first count, after the total if there is one
+  bool hasTotal;
+  long total;
+  uint64_t mtime;    // of the file when it was mapped
+  size_t stride;     // lines between indexed line starts
+  std::vector<uint64_t> index; // offsets of every stride-th line
+
+  const char* lineEnd(const char* line) const;
+  void keyOf(const char* line, const char*& key, size_t& length) const;
+  template<class Predicate> const char* firstLine(Predicate pred) const;
+
+ public:
+  /** Maps path and indexes every stride-th line. If indexPath is
+      given, the index is loaded from it if it's up to date, and
+      written to it otherwise. */
+  CountFileView(const std::string& path, const std::string& indexPath = "",
+                size_t stride = 64);
+  ~CountFileView();
+
+  /** Whether the first line of the file is the total of its counts */
+  bool startsWithTotal() const { return hasTotal; }
+  long fileTotal() const { return total; }
+
+  /** Looks up the count of key. Returns false if there's none. */
+  bool lookup(const char* key, size_t length, long& count) const;
+  bool lookup(const std::string& key, long& count) const
+  {
+    return lookup(key.data(), key.size(), count);
+  }
+
+  /** Returns the counts of all keys starting with prefix, in order */
+  CountRangeReader prefixRange(const char* prefix, size_t length) const;
+  CountRangeReader prefixRange(const std::string& prefix) const
+  {
+    return prefixRange(prefix.data(), prefix.size());
+  }
+
+  /** Returns all counts of the file, in order */
+  CountRangeReader all() const { return CountRangeReader(first, data + size); }
+
+  void buildIndex();
+  bool loadIndex(const std::string& indexPath);
+  void saveIndex(const std::string& indexPath) const;
+};
+
+#endif // CountFileView_h
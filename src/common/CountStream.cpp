@@ -0,0 +1,61 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    CountStream.cpp: readers and writers for streams of counts. Mergers
+                     and counters work in terms of CountReader and
+                     CountWriter so that they don't depend on how the
+                     counts are actually stored.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+
+#include "CountStream.h"
+#include "utilities.h"
+
+using namespace std;
+
+bool TextCountReader::next()
+{
+  const char* line;
+  size_t length;
+  while(in.next(line, length)) {
+    if(parseCountLine(line, length, currentCount, currentKey, currentLength))
+      return true;
+    cerr << "WARNING: Could not deconstruct count from line:" << endl;
+    cerr << string(line, length) << endl;
+  }
+  return false;
+}
+
+void TextCountWriter::write(const char* key, size_t length, long count)
+{
+  out.write(count);
+  out.put(COUNT_SEPARATOR);
+  out.write(key, length);
+  out.put('\n');
+}
+
+void TextCountWriter::close()
+{
+  out.flush();
+}
@@ -0,0 +1,146 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    CountStream.h: see CountStream.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CountStream_h
+#define CountStream_h
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "LineIO.h"
+
+/** Compares two keys the same way strcmp() compares their
+    NUL-terminated versions. */
+inline int compareKeys(const char* key1, size_t length1,
+                       const char* key2, size_t length2)
+{
+  int cmp = memcmp(key1, key2, std::min(length1, length2));
+  if(cmp != 0)
+    return cmp;
+  return length1 < length2 ? -1 : (length1 > length2 ? 1 : 0);
+}
+
+/** Parses a line of the text format, count\tkey, in place: key
+    points into line. A trailing \r is ignored, and so are spaces
+    before the count, as sscanf() would. Returns false if the line
+    doesn't start with a count followed by a tab. */
+inline bool parseCountLine(const char* line, size_t length, long& count,
+                           const char*& key, size_t& keyLength)
+{
+  if(length > 0 && line[length-1] == '\r')
+    length--;
+  const char* end = line + length;
+  const char* pos = line;
+  while(pos < end && *pos == ' ')
+    pos++;
+  const bool negative = pos < end && *pos == '-';
+  if(pos < end && (*pos == '-' || *pos == '+'))
+    pos++;
+
+  const char* digits = pos;
+  long value = 0;
+  while(pos < end && (unsigned char)(*pos - '0') < 10) {
+    value = value*10 + (*pos - '0');
+    pos++;
+  }
+  if(pos == digits)
+    return false;
+
+  const char* separator = (const char*)memchr(pos, '\t', end - pos);
+  if(separator == NULL)
+    return false;
+  count = negative ? -value : value;
+  key = separator + 1;
+  keyLength = end - key;
+  return true;
+}
+
+/** A stream of (key, count) pairs, usually sorted by key. The key
+    returned by key() is only valid until the next call to next(). */
+class CountReader
+{
+ protected:
+  const char* currentKey;
+  size_t currentLength;
+  long currentCount;
+
+ public:
+  CountReader() : currentKey(NULL), currentLength(0), currentCount(0) { }
+  virtual ~CountReader() { }
+
+  /** Advances to the next count. Returns false at end of stream. */
+  virtual bool next() = 0;
+
+  /** Starts over from the first count. Streams which can only be
+      read once throw a string. */
+  virtual void rewind() { throw std::string("Counts can only be read once."); }
+
+  const char* key() const { return currentKey; }
+  size_t keyLength() const { return currentLength; }
+  long count() const { return currentCount; }
+};
+
+/** A sink for (key, count) pairs. */
+class CountWriter
+{
+ public:
+  virtual ~CountWriter() { }
+  virtual void write(const char* key, size_t length, long count) = 0;
+
+  /** Flushes any buffered output. */
+  virtual void close() { }
+};
+
+/** Reads counts in the text format: count\tkey, one per line. */
+class TextCountReader : public CountReader
+{
+ private:
+  LineReader in;
+
+ public:
+  TextCountReader(FILE* file) : in(file) { }
+
+  /** Reads head, the start of the input which has been read from
+      file already, and then the rest of file */
+  TextCountReader(FILE* file, const std::string& head) : in(file) { in.unread(head); }
+
+  /** Reads length bytes of fd starting at offset, without moving the
+      file position. Several readers may share fd. */
+  TextCountReader(int fd, off_t offset, off_t length) : in(fd, offset, length) { }
+  bool next();
+};
+
+/** Writes counts in the text format: count\tkey, one per line. */
+class TextCountWriter : public CountWriter
+{
+ private:
+  LineWriter out;
+
+ public:
+  TextCountWriter(FILE* file) : out(file) { }
+  void write(const char* key, size_t length, long count);
+  void close();
+};
+
+#endif // CountStream_h
@@ -0,0 +1,223 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    IndexedFile.cpp: an on-disk format for final count files, which are
+                     read many times and often by key. Counts sorted by
+                     key are stored in compressed blocks of the chunk
+                     format (see ChunkFile.cpp), followed by an index of
+                     the first key of every block and a fixed-size
+                     footer:
+
+                       file   := block* index footer
+                       index  := entry*, one per block
+                       entry  := offset(varint) length(varint)
+                                 first key bytes
+                       footer := index offset(uint64) blocks(uint64)
+                                 keys(uint64) key bytes(uint64)
+                                 total(uint64) version(uint32)
+                                 magic(uint32)
+
+                     The footer holds the total count, which is the
+                     first line of the text format, and the number of
+                     keys. A reader loads the index, finds the block
+                     a key would be in with a binary search over first
+                     keys, and decodes only that block, so a lookup
+                     costs one read of about 64KB. Scanning the file
+                     from start to end yields all counts in order.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "IndexedFile.h"
+
+using namespace std;
+
+const uint32_t INDEXED_MAGIC = 0x58494341; // "ACIX"
+const uint32_t INDEXED_VERSION = 1;
+const size_t FOOTER_SIZE = 48;
+
+IndexedWriter::IndexedWriter(FILE* file) : ChunkWriter(file, true) {
+  this->blocks = 0;
+  this->keys = 0;
+  this->keyBytes = 0;
+  this->total = 0;
+}
+
+void IndexedWriter::write(const char* key, size_t length, long count)
+{
+  if(keys > 0 && compareKeys(lastKey.data(), lastKey.size(), key, length) >= 0)
+    throw string("Counts must be sorted by key, without duplicates, to be indexed.");
+
+  if(records == 0)
+    firstKey.assign(key, length);
+  keys++;
+  keyBytes += length;
+  total += count;
+  ChunkWriter::write(key, length, count);
+}
+
+void IndexedWriter::writeBlock()
+{
+  putVarint(index, written);
+  putVarint(index, firstKey.size());
+  index.append(firstKey);
+  blocks++;
+  ChunkWriter::writeBlock();
+}
+
+void IndexedWriter::close()
+{
+  ChunkWriter::close();
+
+  char footer[FOOTER_SIZE];
+  putUint64(footer, written);
+  putUint64(footer+8, blocks);
+  putUint64(footer+16, keys);
+  putUint64(footer+24, keyBytes);
+  putUint64(footer+32, (uint64_t)total);
+  putUint32(footer+40, INDEXED_VERSION);
+  putUint32(footer+44, INDEXED_MAGIC);
+  if(fwrite(index.data(), 1, index.size(), file) != index.size()
+     || fwrite(footer, 1, FOOTER_SIZE, file) != FOOTER_SIZE
+     || fflush(file) != 0)
+    throw string("Could not write indexed file. Out of disk space?");
+}
+
+/// Reads the footer of file into footer. Returns false if the file is
+/// too short, or isn't seekable.
+bool readFooter(FILE* file, char* footer)
+{
+  struct stat info;
+  if(fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)
+     || info.st_size < (off_t)FOOTER_SIZE)
+    return false;
+  return fseeko(file, info.st_size - FOOTER_SIZE, SEEK_SET) == 0
+    && fread(footer, 1, FOOTER_SIZE, file) == FOOTER_SIZE;
+}
+
+bool IndexedReader::readTotal(FILE* file, long& total)
+{
+  // pipes have no footer to read, and can't be seeked back
+  const off_t pos = ftello(file);
+  if(pos < 0)
+    return false;
+  char footer[FOOTER_SIZE];
+  const bool indexed = readFooter(file, footer) && getUint32(footer+44) == INDEXED_MAGIC;
+  if(indexed)
+    total = (long)getUint64(footer+32);
+  fseeko(file, pos, SEEK_SET);
+  return indexed;
+}
+
+bool IndexedReader::isIndexed(FILE* file)
+{
+  long total;
+  return readTotal(file, total);
+}
+
+IndexedReader::IndexedReader(FILE* file) : blocks(file) {
+  this->file = file;
+  this->pending = false;
+
+  char footer[FOOTER_SIZE];
+  if(!readFooter(file, footer) || getUint32(footer+44) != INDEXED_MAGIC)
+    throw string("Not an indexed count file.");
+  if(getUint32(footer+40) != INDEXED_VERSION)
+    throw string("Unsupported version of the indexed count format.");
+
+  const uint64_t indexOffset = getUint64(footer);
+  const uint64_t numBlocks = getUint64(footer+8);
+  this->numKeys = getUint64(footer+16);
+  this->numKeyBytes = getUint64(footer+24);
+  this->totalCount = (long)getUint64(footer+32);
+
+  const off_t footerOffset = ftello(file) - FOOTER_SIZE;
+  if(indexOffset > (uint64_t)footerOffset || numBlocks > (uint64_t)footerOffset)
+    throw string("Corrupt indexed file: invalid footer.");
+  string index(footerOffset - indexOffset, '\0');
+  if(fseeko(file, indexOffset, SEEK_SET) != 0
+     || fread(&index[0], 1, index.size(), file) != index.size())
+    throw string("Could not read the index of an indexed file.");
+
+  size_t pos = 0;
+  for(uint64_t b=0; b<numBlocks; b++) {
+    offsets.push_back(getVarint(index, pos));
+    const size_t length = getVarint(index, pos);
+    if(pos + length > index.size() || offsets.back() >= indexOffset)
+      throw string("Corrupt indexed file: invalid index.");
+    firstKeys.push_back(index.substr(pos, length));
+    pos += length;
+  }
+
+  blocks.seek(0, numBlocks);
+}
+
+bool IndexedReader::next()
+{
+  if(pending) {
+    pending = false;
+    return true;
+  }
+  if(!blocks.next())
+    return false;
+  currentKey = blocks.key();
+  currentLength = blocks.keyLength();
+  currentCount = blocks.count();
+  return true;
+}
+
+bool IndexedReader::seek(const char* key, size_t length)
+{
+  // the key is in the last block whose first key isn't greater
+  size_t lo = 0, hi = firstKeys.size();
+  while(lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    const string& first = firstKeys[mid];
+    if(compareKeys(first.data(), first.size(), key, length) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  const size_t block = lo > 0 ? lo - 1 : 0;
+  pending = false;
+  if(block >= offsets.size())
+    return false;
+
+  blocks.seek(offsets[block], offsets.size() - block);
+  while(next()) {
+    if(compareKeys(currentKey, currentLength, key, length) >= 0) {
+      pending = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IndexedReader::lookup(const char* key, size_t length, long& count)
+{
+  if(!seek(key, length))
+    return false;
+  next();
+  if(compareKeys(currentKey, currentLength, key, length) != 0)
+    return false;
+  count = currentCount;
+  return true;
+}
@@ -0,0 +1,102 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    IndexedFile.h: see IndexedFile.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IndexedFile_h
+#define IndexedFile_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ChunkFile.h"
+
+/** Writes counts sorted by key in the indexed format. The file must
+    be empty, and written from its start. */
+class IndexedWriter : public ChunkWriter
+{
+ private:
+  std::string index; // entries of the blocks written so far
+  std::string firstKey; // of the block being built
+  uint64_t blocks;
+  uint64_t keys;
+  uint64_t keyBytes;
+  long total;
+
+  void writeBlock();
+
+ public:
+  IndexedWriter(FILE* file);
+  void write(const char* key, size_t length, long count);
+
+  /** Writes the last block, the index and the footer */
+  void close();
+};
+
+/** Reads a file written by IndexedWriter, either sequentially with
+    next(), or by key with seek() and lookup(). */
+class IndexedReader : public CountReader
+{
+ private:
+  FILE* file;
+  ChunkReader blocks;
+  std::vector<std::string> firstKeys; // of each block
+  std::vector<uint64_t> offsets;      // of each block
+  uint64_t numKeys;
+  uint64_t numKeyBytes;
+  long totalCount;
+  bool pending; // whether next() should return the current count again
+
+ public:
+  /** Reads the footer and the index of file, and positions the reader
+      at the first count */
+  IndexedReader(FILE* file);
+
+  /** Whether file is in the indexed format. Leaves the file position
+      alone. */
+  static bool isIndexed(FILE* file);
+
+  /** Reads the total of file from its footer, leaving the file
+      position alone. Returns false if file isn't in the indexed
+      format. */
+  static bool readTotal(FILE* file, long& total);
+
+  bool next();
+
+  /** Positions the reader so that next() returns the first count
+      whose key isn't less than key. Returns false if there's none. */
+  bool seek(const char* key, size_t length);
+
+  /** Looks up the count of key, moving the reader just past it.
+      Returns false if there's none. */
+  bool lookup(const char* key, size_t length, long& count);
+
+  /** The sum of all counts */
+  long total() const { return totalCount; }
+
+  /** The number of keys, and their total length */
+  uint64_t keys() const { return numKeys; }
+  uint64_t keyBytes() const { return numKeyBytes; }
+};
+
+#endif // IndexedFile_h
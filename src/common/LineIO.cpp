@@ -0,0 +1,229 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    LineIO.cpp: line-based input and output shared by all tools. Lines
+                are read with read(2) into a large buffer and returned
+                as pointers into it, so reading a line copies nothing.
+                Output is collected in a large buffer and handed to
+                stdio in big blocks.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "LineIO.h"
+
+using namespace std;
+
+LineReader::LineReader(int fd, size_t capacity) {
+  this->fd = fd;
+  this->file = NULL;
+  this->capacity = capacity;
+  this->buffer = (char*)malloc(capacity);
+  this->start = 0;
+  this->end = 0;
+  this->eof = false;
+  this->positional = false;
+  this->offset = 0;
+  this->remaining = 0;
+}
+
+LineReader::LineReader(int fd, off_t offset, off_t length, size_t capacity) {
+  this->fd = fd;
+  this->file = NULL;
+  this->capacity = capacity;
+  this->buffer = (char*)malloc(capacity);
+  this->start = 0;
+  this->end = 0;
+  this->eof = false;
+  this->positional = true;
+  this->offset = offset;
+  this->remaining = length;
+}
+
+LineReader::LineReader(FILE* file, size_t capacity) {
+  this->fd = -1;
+  this->file = file;
+  this->capacity = capacity;
+  this->buffer = (char*)malloc(capacity);
+  this->start = 0;
+  this->end = 0;
+  this->eof = false;
+  this->positional = false;
+  this->offset = 0;
+  this->remaining = 0;
+}
+
+LineReader::~LineReader()
+{
+  free(buffer);
+}
+
+/// Reads more input after the unread data. Moves the unread data to
+/// the front of the buffer first, and grows the buffer if a single
+/// line fills it. Returns false at end of input.
+bool LineReader::fill()
+{
+  if(start > 0) {
+    memmove(buffer, buffer + start, end - start);
+    end -= start;
+    start = 0;
+  }
+  if(end == capacity) {
+    capacity *= 2;
+    buffer = (char*)realloc(buffer, capacity);
+    if(buffer == NULL)
+      throw string("Out of memory: line too long.");
+  }
+
+  ssize_t cRead;
+  if(file != NULL) {
+    cRead = fread(buffer + end, 1, capacity - end, file);
+    if(cRead == 0 && ferror(file))
+      cRead = -1;
+  } else if(positional) {
+    const size_t size = (remaining < (off_t)(capacity - end)) ? remaining : capacity - end;
+    do {
+      cRead = (size == 0) ? 0 : pread(fd, buffer + end, size, offset);
+    } while(cRead < 0 && errno == EINTR);
+    if(cRead > 0) {
+      offset += cRead;
+      remaining -= cRead;
+    }
+  } else {
+    do {
+      cRead = read(fd, buffer + end, capacity - end);
+    } while(cRead < 0 && errno == EINTR);
+  }
+
+  if(cRead < 0)
+    throw string("Read error: ") + strerror(errno);
+  if(cRead == 0) {
+    eof = true;
+    return false;
+  }
+  end += cRead;
+  return true;
+}
+
+bool LineReader::next(const char*& line, size_t& length)
+{
+  size_t searched = start;
+  while(true) {
+    char* newline = (char*)memchr(buffer + searched, '\n', end - searched);
+    if(newline != NULL) {
+      line = buffer + start;
+      length = newline - line;
+      start = newline - buffer + 1;
+      return true;
+    }
+
+    // fill() moves the unread data, so remember how much of it has
+    // been searched already
+    searched = end - start;
+    if(eof || !fill())
+      break;
+  }
+
+  // the last line may lack a newline
+  if(start == end)
+    return false;
+  line = buffer + start;
+  length = end - start;
+  start = end;
+  return true;
+}
+
+bool LineReader::next(string& line)
+{
+  const char* data;
+  size_t length;
+  if(!next(data, length))
+    return false;
+  line.assign(data, length);
+  return true;
+}
+
+void LineReader::unread(const string& data)
+{
+  if(data.size() > start) {
+    const size_t unreadSize = end - start;
+    if(unreadSize + data.size() > capacity) {
+      capacity = unreadSize + data.size();
+      buffer = (char*)realloc(buffer, capacity);
+      if(buffer == NULL)
+        throw string("Out of memory: line too long.");
+    }
+    memmove(buffer + data.size(), buffer + start, unreadSize);
+    start = data.size();
+    end = start + unreadSize;
+  }
+  start -= data.size();
+  memcpy(buffer + start, data.data(), data.size());
+}
+
+LineWriter::LineWriter(FILE* file, size_t capacity) {
+  this->file = file;
+  this->capacity = capacity;
+  this->buffer = new char[capacity];
+  this->used = 0;
+}
+
+LineWriter::~LineWriter()
+{
+  // only flush if there's something left, since the FILE may have
+  // been closed after an explicit flush()
+  try {
+    if(used > 0)
+      flush();
+  } catch(string err) {
+  }
+  delete[] buffer;
+}
+
+void LineWriter::write(long value)
+{
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  unsigned long magnitude = value < 0 ? -(unsigned long)value : value;
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while(magnitude > 0);
+  if(value < 0)
+    *--p = '-';
+  write(p, digits + sizeof(digits) - p);
+}
+
+void LineWriter::writeThrough(const char* data, size_t length)
+{
+  if(fwrite(data, 1, length, file) != length)
+    throw string("Write error: ") + strerror(errno);
+}
+
+void LineWriter::flush()
+{
+  size_t length = used;
+  used = 0;
+  writeThrough(buffer, length);
+  if(fflush(file) != 0)
+    throw string("Write error: ") + strerror(errno);
+}
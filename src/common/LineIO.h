@@ -0,0 +1,127 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    LineIO.h: see LineIO.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LineIO_h
+#define LineIO_h
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <string.h>
+#include <string>
+
+/** Reads lines from a file descriptor through a large buffer. */
+class LineReader
+{
+ private:
+  int fd;
+  FILE* file;      // read with fread() instead of fd, if not NULL
+  char* buffer;
+  size_t capacity;
+  size_t start; // start of the unread data within buffer
+  size_t end;   // end of the unread data
+  bool eof;
+  bool positional; // read a range of fd with pread(), see below
+  off_t offset;    // of the next read within fd, if positional
+  off_t remaining; // bytes of the range left to read, if positional
+
+  bool fill();
+
+ public:
+  LineReader(int fd, size_t capacity = 1024*1024);
+
+  /** Reads the length bytes of fd starting at offset, leaving the
+      file offset of fd alone, so that several readers can read
+      different ranges of the same file at once. */
+  LineReader(int fd, off_t offset, off_t length, size_t capacity = 1024*1024);
+
+  /** Reads a stdio stream, starting with whatever stdio has buffered
+      already, so that the first lines can be read with stdio. */
+  LineReader(FILE* file, size_t capacity = 1024*1024);
+  ~LineReader();
+
+  /** Reads the next line, without its terminating newline. The line
+      points into the reader's buffer and is only valid until the next
+      call. Returns false at end of input. */
+  bool next(const char*& line, size_t& length);
+
+  /** Same as above, but copies the line into a string */
+  bool next(std::string& line);
+
+  /** Puts data back in front of the unread input, as if it had never
+      been read. Used for input which was peeked at with stdio and
+      can't be seeked back, such as a pipe. */
+  void unread(const std::string& data);
+};
+
+/** Writes to a FILE through a large buffer of its own, so that each
+    write is a memcpy() rather than a locked stdio call. */
+class LineWriter
+{
+ private:
+  FILE* file;
+  char* buffer;
+  size_t capacity;
+  size_t used;
+
+ public:
+  LineWriter(FILE* file, size_t capacity = 1024*1024);
+
+  /** Flushes anything still buffered, ignoring errors. Call flush()
+      to check for them. */
+  ~LineWriter();
+
+  void write(const char* data, size_t length)
+  {
+    if(used + length > capacity) {
+      flush();
+      if(length > capacity) {
+        writeThrough(data, length);
+        return;
+      }
+    }
+    memcpy(buffer + used, data, length);
+    used += length;
+  }
+
+  void write(const std::string& str) { write(str.data(), str.size()); }
+
+  void put(char ch)
+  {
+    if(used == capacity)
+      flush();
+    buffer[used++] = ch;
+  }
+
+  /** Writes a number in decimal */
+  void write(long value);
+
+  /** Writes the buffer to the FILE and flushes it. Throws a string on
+      errors. */
+  void flush();
+
+ private:
+  void writeThrough(const char* data, size_t length);
+};
+
+#endif // LineIO_h
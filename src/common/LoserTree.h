@@ -0,0 +1,109 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    LoserTree.h: a tournament tree of losers for k-way merging. Picking
+                 the next smallest element out of k sorted sources takes
+                 log2(k) comparisons.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LoserTree_h
+#define LoserTree_h
+
+#include <vector>
+
+/** Merges k sorted sources identified by their indices 0..k-1. Less
+    compares the current elements of two sources. Exhausted sources
+    lose every match. Ties are broken arbitrarily, so Less should
+    order equal elements itself if the order matters. */
+template<class Less>
+class LoserTree
+{
+ private:
+  size_t k;
+  Less less;
+  std::vector<size_t> losers; // losers[0] is the overall winner
+  std::vector<bool> exhausted;
+
+  /** Does source a win against source b? */
+  bool beats(size_t a, size_t b) const
+  {
+    if(exhausted[a])
+      return false;
+    if(exhausted[b])
+      return true;
+    return less(a, b);
+  }
+
+ public:
+  LoserTree(size_t k, const Less& less)
+    : k(k), less(less), losers(k, 0), exhausted(k, true) { }
+
+  /** Plays the initial tournament. hasMore[i] tells whether source i
+      has a current element. */
+  void start(const std::vector<bool>& hasMore)
+  {
+    for(size_t i=0; i<k; i++)
+      exhausted[i] = !hasMore[i];
+    if(k == 0)
+      return;
+
+    // internal nodes are 1..k-1 and leaves k..2k-1, heap-style
+    std::vector<size_t> winners(2*k);
+    for(size_t i=0; i<k; i++)
+      winners[k+i] = i;
+
+    for(size_t node=k-1; node >= 1; node--) {
+      size_t a = winners[2*node], b = winners[2*node+1];
+      if(beats(a, b)) {
+        winners[node] = a;
+        losers[node] = b;
+      } else {
+        winners[node] = b;
+        losers[node] = a;
+      }
+    }
+    losers[0] = winners[1];
+  }
+
+  /** Index of the source with the smallest current element */
+  size_t winner() const { return losers[0]; }
+
+  /** True once all sources are exhausted */
+  bool done() const { return k == 0 || exhausted[losers[0]]; }
+
+  /** Replays the winner's matches after it has been advanced */
+  void next(bool hasMore)
+  {
+    size_t winner = losers[0];
+    exhausted[winner] = !hasMore;
+
+    for(size_t node=(winner+k)/2; node >= 1; node /= 2) {
+      if(beats(losers[node], winner)) {
+        size_t loser = winner;
+        winner = losers[node];
+        losers[node] = loser;
+      }
+    }
+    losers[0] = winner;
+  }
+};
+
+#endif // LoserTree_h
@@ -1,37 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
+#include <string>
 #include "merge.h"
+#include "ParallelMerge.h"
+#include "TopCounts.h"
+#include "IndexedFile.h"
 
 using namespace std;
 
-int main(int argc, char ** argv) {
-  char* srcPath1;
-  char* srcPath2;
+struct
+{
+  size_t top;     // only write this many most frequent keys, or 0 for all
+  size_t threads; // of plain merges
+  bool indexed;   // write the indexed format instead of text
+} options;
+
+/// Reads the total on the first line of a count file, or in the
+/// footer of an indexed file
+long readTotal(FILE* file, const string& path)
+{
+  long total;
+  if(IndexedReader::readTotal(file, total))
+    return total;
+  if(fscanf(file, "%ld", &total) != 1)
+    throw string("Could not read the total of ") + path;
+  int next = fgetc(file);
+  if(next == '\r')
+    next = fgetc(file);
+  if(next != '\n')
+    throw string("Could not read the total of ") + path;
+  return total;
+}
+
+/// Reads the total on the first line of a count file into total, if
+/// the file starts with one. Otherwise stores what was read of the
+/// file in head, which is empty only if the file is, and returns
+/// false. Indexed files always have a total.
+bool readOptionalTotal(FILE* file, long& total, string& head)
+{
+  head.clear();
+  if(IndexedReader::readTotal(file, total))
+    return true;
+
+  // a total is a number on a line of its own, while counts are
+  // followed by a tab and a key. Pipes can't be seeked back, so
+  // whatever was read is handed to the reader instead.
+  int next;
+  while(head.size() < 64 && (next = fgetc(file)) != EOF) {
+    head += (char)next;
+    if(next == '\n')
+      break;
+  }
+  const char* line = head.c_str();
+  char* end;
+  total = strtol(line, &end, 10);
+  if(end != line && (strcmp(end, "\n") == 0 || strcmp(end, "\r\n") == 0)) {
+    head.clear();
+    return true;
+  }
+  return false;
+}
+
+/// Opens files for reading, or throws a string naming the first one
+/// that couldn't be opened after closing the others
+void openAll(const vector<string>& paths, vector<FILE*>& files)
+{
+  for(size_t i=0; i<paths.size(); i++) {
+    FILE* file = fopen(paths[i].c_str(), "r");
+    if(file == NULL) {
+      for(size_t j=0; j<files.size(); j++)
+        fclose(files[j]);
+      files.clear();
+      throw string("Error opening file ") + paths[i];
+    }
+    files.push_back(file);
+  }
+}
+
+void closeAll(vector<FILE*>& files)
+{
+  for(size_t i=0; i<files.size(); i++)
+    fclose(files[i]);
+  files.clear();
+}
+
+/// Merges sorted count files, in the text or in the indexed format,
+/// into out. Unless options.top is 0, only the top most frequent keys
+/// are written, most frequent first. If heads isn't empty, heads[i]
+/// is the start of text file i which has been read already. Returns
+/// the sum of all counts.
+long mergeFiles(vector<FILE*>& sources, FILE* out,
+                const vector<string>& heads = vector<string>())
+{
+  vector<bool> indexed;
+  bool plain = options.top == 0 && !options.indexed;
+  for(size_t i=0; i<sources.size(); i++) {
+    indexed.push_back(IndexedReader::isIndexed(sources[i]));
+    plain = plain && !indexed.back();
+  }
+  if(plain && options.threads > 1)
+    return mergeCountsParallel(sources, out, options.threads, heads);
+  if(plain)
+    return mergeCountsN(sources, out, heads);
+
+  vector<CountReader*> readers;
+  CountWriter* writer = NULL;
+  long c_total;
+  try {
+    for(size_t i=0; i<sources.size(); i++) {
+      if(indexed[i])
+        readers.push_back(new IndexedReader(sources[i]));
+      else if(heads.empty())
+        readers.push_back(new TextCountReader(sources[i]));
+      else
+        readers.push_back(new TextCountReader(sources[i], heads[i]));
+    }
+    if(options.indexed)
+      writer = new IndexedWriter(out);
+    else if(options.top > 0)
+      writer = new TopCountWriter(out, options.top);
+    else
+      writer = new TextCountWriter(out);
+    c_total = mergeCounts(readers, *writer);
+  } catch(string err) {
+    for(size_t i=0; i<readers.size(); i++)
+      delete readers[i];
+    delete writer;
+    throw;
+  }
+  for(size_t i=0; i<readers.size(); i++)
+    delete readers[i];
+  delete writer;
+  return c_total;
+}
 
-  FILE* srcFile1;
-  FILE* srcFile2;
+/// Merges partition p of partitioned count files (see the
+/// --partitions option of ngrams) into partition p of out. Unlike
+/// plain merges, partitions start with their total, and so does the
+/// merged partition unless it's indexed.
+void mergePartition(const vector<string>& prefixes, const string& outPrefix, long p)
+{
+  char suffix[32];
+  sprintf(suffix, ".%ld", p);
+  vector<string> paths;
+  for(size_t i=0; i<prefixes.size(); i++)
+    paths.push_back(prefixes[i] + suffix);
+  const string outPath = outPrefix + suffix;
 
-  if(argc != 3) {
-    cerr << "Usage: " << argv[0] << " file1 file2" << endl;
+  vector<FILE*> sources;
+  openAll(paths, sources);
+  FILE* out = fopen(outPath.c_str(), "w");
+  if(out == NULL) {
+    closeAll(sources);
+    throw string("Error opening partition ") + outPath;
+  }
+
+  long total = 0, c_total;
+  try {
+    for(size_t i=0; i<sources.size(); i++)
+      total += readTotal(sources[i], paths[i]);
+    if(!options.indexed)
+      fprintf(out, "%ld\n", total);
+    c_total = mergeFiles(sources, out);
+  } catch(string err) {
+    closeAll(sources);
+    fclose(out);
+    throw;
+  }
+
+  closeAll(sources);
+  if(fclose(out) != 0)
+    throw string("Could not write ") + outPath;
+  if(c_total != total)
+    cerr << "WARNING: counts of " << outPath << " do not match the totals: "
+         << c_total << " vs. " << total << endl;
+}
+
+/// Merges count files into stdout. If the files start with their
+/// totals, as the output of ngrams does, so does the text output,
+/// with the sum of the totals.
+void mergeAll(const vector<string>& paths)
+{
+  vector<FILE*> sources;
+  openAll(paths, sources);
+
+  try {
+    long total = 0;
+    size_t withTotal = 0, withoutTotal = 0;
+    vector<string> heads(sources.size());
+    for(size_t i=0; i<sources.size(); i++) {
+      long t;
+      if(readOptionalTotal(sources[i], t, heads[i])) {
+        total += t;
+        withTotal++;
+      } else if(!heads[i].empty()) {
+        // empty files go with either
+        withoutTotal++;
+      }
+    }
+    if(withTotal > 0 && withoutTotal > 0)
+      throw string("Either all or none of the files must start with a total.");
+
+    if(withTotal > 0 && !options.indexed)
+      printf("%ld\n", total);
+    long c_total = mergeFiles(sources, stdout, heads);
+    if(withTotal > 0 && c_total != total)
+      cerr << "WARNING: counts do not match the totals: " << c_total << " vs. " << total << endl;
+  } catch(string err) {
+    closeAll(sources);
+    throw;
+  }
+  closeAll(sources);
+}
+
+void printUsage(const char* name)
+{
+  cerr << "Usage: " << name << " [--top K|--indexed] [-j THREADS] file1 file2 ... fileN" << endl;
+  cerr << "       " << name << " [--top K|--indexed] [-j THREADS] --partitions K prefix1 prefix2 ... prefixN outprefix" << endl;
+}
+
+int main(int argc, char ** argv) {
+  long top = 0;
+  long partitions = 0;
+  long threads = 1;
+  options.indexed = false;
+  int i = 1;
+  for(; i<argc-1; i++) {
+    if(strcmp(argv[i], "--top") == 0)
+      top = atol(argv[++i]);
+    else if(strcmp(argv[i], "--partitions") == 0)
+      partitions = atol(argv[++i]);
+    else if(strcmp(argv[i], "-j") == 0)
+      threads = atol(argv[++i]);
+    else if(strcmp(argv[i], "--indexed") == 0)
+      options.indexed = true;
+    else
+      break;
+  }
+
+  // indexed files are sorted by key, not by count
+  if(top < 0 || partitions < 0 || threads <= 0 || (top > 0 && options.indexed)) {
+    printUsage(argv[0]);
     return 1;
   }
-  
-  srcPath1 = argv[1];
-  srcPath2 = argv[2];
+  options.top = top;
+  options.threads = threads;
 
-  if((srcFile1 = fopen(srcPath1, "r"))) {
-    if((srcFile2 = fopen(srcPath2, "r"))) {
-      try {
-        mergeCounts(srcFile1, srcFile2, stdout);
-      } catch(string error) {
-        cerr << error << endl;
+  vector<string> paths(argv + i, argv + argc);
+  try {
+    if(partitions > 0) {
+      if(paths.size() < 2) {
+        printUsage(argv[0]);
         return 1;
       }
+      const string outPrefix = paths.back();
+      paths.pop_back();
+      for(long p=0; p<partitions; p++)
+        mergePartition(paths, outPrefix, p);
     } else {
-      cerr << "Error opening file" << srcPath2 << endl;
-      return 1;
+      if(paths.empty()) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      mergeAll(paths);
     }
-  } else {
-    cerr << "Error opening file " << srcPath1 << endl;
+  } catch(string error) {
+    cerr << error << endl;
     return 1;
   }
   return 0;
@@ -0,0 +1,271 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    ParallelMerge.cpp: merges sorted count files with several threads.
+                       Keys sampled from all inputs are used as pivots
+                       which split the key space into ranges of about
+                       equal size. The start of each range within each
+                       input is found with a binary search over byte
+                       offsets, and each range is merged by its own
+                       thread. Equal keys always fall into the same
+                       range, so the merged ranges only need to be
+                       concatenated in order.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include "ParallelMerge.h"
+#include "merge.h"
+
+using namespace std;
+
+const size_t SAMPLES_PER_THREAD = 16; // pivots are picked out of this many samples
+const size_t PROBE_SIZE = 4096;       // bytes read at once when looking for lines
+
+/// The counts of a file, from byte start to end
+struct CountRange
+{
+  int fd;
+  off_t start;
+  off_t end;
+};
+
+/// Reads up to size bytes at offset, retrying on interrupts
+ssize_t readAt(int fd, char* buffer, size_t size, off_t offset)
+{
+  ssize_t cRead;
+  do {
+    cRead = pread(fd, buffer, size, offset);
+  } while(cRead < 0 && errno == EINTR);
+
+  if(cRead < 0)
+    throw string("Read error: ") + strerror(errno);
+  return cRead;
+}
+
+/// Returns the start of the first line at or after pos, or the end
+/// of the range if there's none
+off_t lineStartAt(const CountRange& range, off_t pos)
+{
+  if(pos <= range.start)
+    return range.start;
+
+  // a line starts at pos if the previous byte ends a line
+  char buffer[PROBE_SIZE];
+  for(off_t at = pos - 1; at < range.end; ) {
+    ssize_t cRead = readAt(range.fd, buffer, min((off_t)PROBE_SIZE, range.end - at), at);
+    if(cRead == 0)
+      break;
+    const char* newline = (const char*)memchr(buffer, '\n', cRead);
+    if(newline != NULL)
+      return min(at + (newline - buffer) + 1, range.end);
+    at += cRead;
+  }
+  return range.end;
+}
+
+/// Reads the key of the line starting at pos. Lines which aren't
+/// counts are taken to be their own keys.
+void keyAt(const CountRange& range, off_t pos, string& key)
+{
+  string line;
+  char buffer[PROBE_SIZE];
+  while(pos < range.end) {
+    ssize_t cRead = readAt(range.fd, buffer, min((off_t)PROBE_SIZE, range.end - pos), pos);
+    if(cRead == 0)
+      break;
+    const char* newline = (const char*)memchr(buffer, '\n', cRead);
+    line.append(buffer, newline ? newline - buffer : cRead);
+    if(newline != NULL)
+      break;
+    pos += cRead;
+  }
+
+  long count;
+  const char* start;
+  size_t length;
+  if(parseCountLine(line.data(), line.size(), count, start, length))
+    key.assign(start, length);
+  else
+    key.swap(line);
+}
+
+/// Returns the start of the first line of a range whose key isn't
+/// less than pivot, or the end of the range if there's none
+off_t lowerBound(const CountRange& range, const string& pivot)
+{
+  // find the smallest position whose next line has a key of at least
+  // pivot. Since keys are sorted, positions before it lead to lines
+  // with smaller keys, and positions after it to the same line or
+  // later ones.
+  off_t lo = range.start, hi = range.end;
+  string key;
+  while(lo < hi) {
+    const off_t mid = lo + (hi - lo) / 2;
+    const off_t line = lineStartAt(range, mid);
+    if(line == range.end)
+      hi = mid;
+    else {
+      keyAt(range, line, key);
+      if(compareKeys(key.data(), key.size(), pivot.data(), pivot.size()) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  }
+  return lineStartAt(range, lo);
+}
+
+/// Picks up to parts-1 keys which split the counts of all ranges into
+/// parts of about equal size
+void pickPivots(const vector<CountRange>& ranges, size_t parts, vector<string>& pivots)
+{
+  off_t total = 0;
+  for(size_t i=0; i<ranges.size(); i++)
+    total += ranges[i].end - ranges[i].start;
+  if(total == 0)
+    return;
+
+  // larger inputs get more samples, at evenly spaced offsets
+  vector<string> samples;
+  string key;
+  for(size_t i=0; i<ranges.size(); i++) {
+    const off_t size = ranges[i].end - ranges[i].start;
+    const size_t numSamples = (size_t)((double)SAMPLES_PER_THREAD * parts * size / total);
+    for(size_t s=0; s<numSamples; s++) {
+      const off_t line = lineStartAt(ranges[i], ranges[i].start + size * s / numSamples);
+      if(line == ranges[i].end)
+        continue;
+      keyAt(ranges[i], line, key);
+      samples.push_back(key);
+    }
+  }
+  sort(samples.begin(), samples.end());
+
+  for(size_t p=1; p<parts && !samples.empty(); p++) {
+    const string& pivot = samples[samples.size() * p / parts];
+    if(pivots.empty() || pivots.back() != pivot)
+      pivots.push_back(pivot);
+  }
+}
+
+/// Merges part p of all ranges, between bounds[i][p] and
+/// bounds[i][p+1] of range i, into out
+void mergePart(const vector<CountRange>& ranges, const vector<vector<off_t> >& bounds,
+               size_t p, FILE* out, long& c_total, string& error)
+{
+  vector<CountReader*> readers;
+  try {
+    for(size_t i=0; i<ranges.size(); i++) {
+      const off_t start = bounds[i][p], end = bounds[i][p+1];
+      readers.push_back(new TextCountReader(ranges[i].fd, start, end - start));
+    }
+    TextCountWriter writer(out);
+    c_total = mergeCounts(readers, writer);
+  } catch(string err) {
+    error = err;
+  }
+  for(size_t i=0; i<readers.size(); i++)
+    delete readers[i];
+}
+
+long mergeCountsParallel(vector<FILE*>& sources, FILE* out, size_t threads,
+                         const vector<string>& heads)
+{
+  vector<CountRange> ranges;
+  for(size_t i=0; i<sources.size(); i++) {
+    struct stat info;
+    long pos = ftell(sources[i]);
+    if(pos >= 0 && !heads.empty())
+      pos -= heads[i].size();
+    if(fstat(fileno(sources[i]), &info) != 0 || !S_ISREG(info.st_mode) || pos < 0)
+      return mergeCountsN(sources, out, heads);
+    CountRange range = { fileno(sources[i]), pos, info.st_size };
+    ranges.push_back(range);
+  }
+
+  vector<string> pivots;
+  if(threads > 1)
+    pickPivots(ranges, threads, pivots);
+  if(pivots.empty())
+    return mergeCountsN(sources, out, heads);
+
+  // bounds[i][p] is where part p starts within range i
+  const size_t parts = pivots.size() + 1;
+  vector<vector<off_t> > bounds(ranges.size());
+  for(size_t i=0; i<ranges.size(); i++) {
+    bounds[i].push_back(ranges[i].start);
+    for(size_t p=0; p<pivots.size(); p++)
+      bounds[i].push_back(lowerBound(ranges[i], pivots[p]));
+    bounds[i].push_back(ranges[i].end);
+  }
+
+  // the first part goes straight to out, the others are appended
+  // once they're done
+  vector<FILE*> outputs(parts, NULL);
+  vector<long> totals(parts, 0);
+  vector<string> errors(parts);
+  outputs[0] = out;
+  for(size_t p=1; p<parts; p++) {
+    if((outputs[p] = tmpfile()) == NULL) {
+      for(size_t q=1; q<p; q++)
+        fclose(outputs[q]);
+      throw string("Could not create a temporary file for merged counts.");
+    }
+  }
+
+  boost::thread_group workers;
+  for(size_t p=0; p<parts; p++)
+    workers.create_thread(boost::bind(mergePart, boost::cref(ranges), boost::cref(bounds), p,
+                                      outputs[p], boost::ref(totals[p]), boost::ref(errors[p])));
+  workers.join_all();
+
+  long c_total = 0;
+  string error;
+  char buffer[64*1024];
+  for(size_t p=0; p<parts; p++) {
+    c_total += totals[p];
+    if(!errors[p].empty() && error.empty())
+      error = errors[p];
+    if(p == 0)
+      continue;
+
+    rewind(outputs[p]);
+    size_t cRead;
+    while(error.empty() && (cRead = fread(buffer, 1, sizeof(buffer), outputs[p])) > 0) {
+      if(fwrite(buffer, 1, cRead, out) != cRead)
+        error = "Could not write merged counts.";
+    }
+    if(error.empty() && ferror(outputs[p]))
+      error = "Could not read merged counts back from a temporary file.";
+    fclose(outputs[p]);
+  }
+
+  if(!error.empty())
+    throw error;
+  return c_total;
+}
@@ -0,0 +1,42 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    ParallelMerge.h: see ParallelMerge.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ParallelMerge_h
+#define ParallelMerge_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/** Merges sorted count files in the text format into out like
+    mergeCountsN(), but with up to threads threads, each merging its
+    own range of keys. Each file is read from its current position to
+    its end, or from where heads[i] starts if heads isn't empty (see
+    mergeCountsN()). The output is the same as that of mergeCountsN().
+    Files which aren't regular files are merged by mergeCountsN().
+    Returns the sum of all counts. */
+long mergeCountsParallel(std::vector<FILE*>& sources, FILE* out, size_t threads,
+                         const std::vector<std::string>& heads = std::vector<std::string>());
+
+#endif // ParallelMerge_h
@@ -0,0 +1,66 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    TopCounts.cpp: selects the k most frequent keys of a count stream,
+                   such as the output of a merge, with a bounded heap.
+                   Only k counts are ever held in memory, and nothing
+                   but those k is sorted by count.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include "TopCounts.h"
+
+using namespace std;
+
+void TopCountWriter::write(const char* key, size_t length, long count)
+{
+  if(k == 0)
+    return;
+
+  if(heap.size() < k) {
+    heap.push_back(KeyCount());
+    heap.back().count = count;
+    heap.back().key.assign(key, length);
+    push_heap(heap.begin(), heap.end(), KeyCount::before);
+    return;
+  }
+
+  // the root is the least frequent count kept so far. Merged keys
+  // arrive in increasing order, so a count only displaces it if it's
+  // higher, but any order of keys works.
+  KeyCount& least = heap.front();
+  if(!frequentFirst(count, key, length, least.count, least.key.data(), least.key.size()))
+    return;
+
+  pop_heap(heap.begin(), heap.end(), KeyCount::before);
+  heap.back().count = count;
+  heap.back().key.assign(key, length);
+  push_heap(heap.begin(), heap.end(), KeyCount::before);
+}
+
+void TopCountWriter::close()
+{
+  sort_heap(heap.begin(), heap.end(), KeyCount::before);
+  for(size_t i=0; i<heap.size(); i++)
+    out.write(heap[i].key.data(), heap[i].key.size(), heap[i].count);
+  heap.clear();
+  out.close();
+}
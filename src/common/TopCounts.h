@@ -0,0 +1,70 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    TopCounts.h: see TopCounts.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TopCounts_h
+#define TopCounts_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "CountStream.h"
+
+/** The order of counts most frequent first: true if (count1, key1)
+    has the higher count, or the same count and the smaller key */
+inline bool frequentFirst(long count1, const char* key1, size_t length1,
+                          long count2, const char* key2, size_t length2)
+{
+  return count1 > count2
+    || (count1 == count2 && compareKeys(key1, length1, key2, length2) < 0);
+}
+
+/** A key and its count, ordered most frequent first */
+struct KeyCount
+{
+  long count;
+  std::string key;
+
+  /** True if a comes before b in the order of frequentFirst() */
+  static bool before(const KeyCount& a, const KeyCount& b)
+  {
+    return frequentFirst(a.count, a.key.data(), a.key.size(), b.count, b.key.data(), b.key.size());
+  }
+};
+
+/** Keeps the k most frequent of the counts written to it, and writes
+    them out in the text format, most frequent first, when closed. */
+class TopCountWriter : public CountWriter
+{
+ private:
+  size_t k;
+  std::vector<KeyCount> heap; // the least frequent count first
+  TextCountWriter out;
+
+ public:
+  TopCountWriter(FILE* file, size_t k) : k(k), out(file) { }
+  void write(const char* key, size_t length, long count);
+  void close();
+};
+
+#endif // TopCounts_h
@@ -27,96 +27,131 @@
 #include <iostream>
 
 #include "merge.h"
+#include "ChunkFile.h"
+#include "LoserTree.h"
 #include "utilities.h"
 
 using namespace std;
 
-const size_t buf_size = 1024*1024;
+/// Merges two sorted files with counts into a third sorted file with
+/// the sum of counts. Returns the sum of counts.
+size_t mergeCounts(FILE* src1, FILE* src2, FILE* out)
+{ 
+  vector<FILE*> sources;
+  sources.push_back(src1);
+  sources.push_back(src2);
+  long c_total = mergeCountsN(sources, out);
+  rewind(out);
+  
+  return c_total;
+}
 
-char* read_line(char* buf, size_t n, FILE* f, bool& hasMore)
+/// Merges sorted files with counts into another sorted file with the
+/// sum of counts, reading each file once. Returns the sum of counts.
+long mergeCountsN(vector<FILE*>& sources, FILE* out, const vector<string>& heads)
 {
-  char* result;
-  hasMore = (result = fgets(buf, n, f)) != NULL;
-  return result;
-}  
+  vector<TextCountReader*> readers;
+  vector<CountReader*> counts;
+  for(size_t i=0; i<sources.size(); i++) {
+    if(heads.empty())
+      readers.push_back(new TextCountReader(sources[i]));
+    else
+      readers.push_back(new TextCountReader(sources[i], heads[i]));
+    counts.push_back(readers.back());
+  }
 
-void readCount(FILE* f, char* key, long& count, bool& hasMore)
-{
-  char line[buf_size];
-  do {
-    read_line(line, buf_size, f, hasMore);  
-    if(hasMore && !deconstructCount(line, key, &count)) {
-      cerr << "WARNING: Could not deconstruct count from line:" << endl;
-      cerr << line;
-      continue;
-    } else {
-      break;
-    }
-  } while(hasMore); // loops until we get a successful parse of EOF
+  TextCountWriter writer(out);
+  long c_total;
+  try {
+    c_total = mergeCounts(counts, writer);
+  } catch(string err) {
+    for(size_t i=0; i<readers.size(); i++)
+      delete readers[i];
+    throw;
+  }
+  for(size_t i=0; i<readers.size(); i++)
+    delete readers[i];
+
+  for(size_t i=0; i<sources.size(); i++) {
+    if(!feof(sources[i]))
+      throw string("Read error. All counts have been processed, but end of file has not been reached.");
+  }
+  return c_total;
 }
 
-void inline printCount(FILE* out, const char* key, const long count)
+/// Merges sorted chunk files into another chunk file and rewinds
+/// it. The sources are left open. Returns the sum of counts.
+long mergeChunkFiles(vector<FILE*>& sources, FILE* out, bool compress)
 {
-  fprintf(out, "%ld%c%s\n", count, COUNT_SEPARATOR, key);
+  vector<CountReader*> readers;
+  for(size_t i=0; i<sources.size(); i++)
+    readers.push_back(new ChunkReader(sources[i]));
+
+  ChunkWriter writer(out, compress);
+  long c_total = mergeCounts(readers, writer);
+
+  for(size_t i=0; i<readers.size(); i++)
+    delete readers[i];
+
+  rewind(out);
+  return c_total;
 }
 
-/// Merges two sorted files with counts into a third sorted file with
-/// the sum of counts. Returns the sum of counts.
-size_t mergeCounts(FILE* src1, FILE* src2, FILE* out)
-{ 
-  bool hasMore1, hasMore2;
-  char key1[buf_size];
-  char key2[buf_size];
-  long c1=0, c2=0, c_total=0;
-
-  readCount(src1, key1, c1, hasMore1);
-  readCount(src2, key2, c2, hasMore2);
-
-  while(hasMore1 || hasMore2) {
-    /* Both counts present? */
-    if(hasMore1 && hasMore2) {
-      int cmp = strcmp(key1, key2);
-      if(cmp == 0) {
-        /* words from both chunks equal: add counts */
-        printCount(out, key1, c1+c2);
-        c_total+=(c1+c2);
-        readCount(src1, key1, c1, hasMore1);
-        readCount(src2, key2, c2, hasMore2);
-        continue;
-      }
-      /* word from first chunk is smaller? */
-      else if(cmp < 0) {
-        printCount(out, key1, c1);
-        c_total += c1;
-        readCount(src1, key1, c1, hasMore1);
-        continue;
-      }
-      /* word from second chunk is smaller? */
-      else {
-        printCount(out, key2, c2);
-        c_total += c2;
-        readCount(src2, key2, c2, hasMore2);
-        continue;
-      }
+/// Orders count readers by their current keys
+struct ReaderLess
+{
+  std::vector<CountReader*>* sources;
+
+  ReaderLess(std::vector<CountReader*>* sources) : sources(sources) { }
+
+  bool operator() (size_t a, size_t b) const
+  {
+    CountReader* r1 = (*sources)[a];
+    CountReader* r2 = (*sources)[b];
+    return compareKeys(r1->key(), r1->keyLength(), r2->key(), r2->keyLength()) < 0;
+  }
+};
+
+/// Merges k sorted count streams using a loser tree, so that each
+/// count is read and written exactly once regardless of k. Counts
+/// below threshold are dropped as they're merged, which is only
+/// right once the sources hold all counts. Returns the sum of counts.
+long mergeCounts(vector<CountReader*>& sources, CountWriter& out,
+                 long threshold, long* c_kept)
+{
+  vector<bool> hasMore(sources.size());
+  for(size_t i=0; i<sources.size(); i++)
+    hasMore[i] = sources[i]->next();
+
+  LoserTree<ReaderLess> tree(sources.size(), ReaderLess(&sources));
+  tree.start(hasMore);
+
+  string key;
+  long c_total = 0, c_written = 0;
+  while(!tree.done()) {
+    CountReader* src = sources[tree.winner()];
+    key.assign(src->key(), src->keyLength());
+    long c = src->count();
+    tree.next(src->next());
+
+    // add up the counts of the same key coming from other sources
+    while(!tree.done()) {
+      src = sources[tree.winner()];
+      if(compareKeys(src->key(), src->keyLength(), key.data(), key.size()) != 0)
+        break;
+      c += src->count();
+      tree.next(src->next());
     }
-    /* Only first line nonempty */
-    else if(hasMore1) {
-      printCount(out, key1, c1);
-      c_total += c1;
-      readCount(src1, key1, c1, hasMore1);
-    } 
-    /* Only second line nonempty */
-    else if(hasMore2) {
-      printCount(out, key2, c2);
-      c_total += c2;
-      readCount(src2, key2, c2, hasMore2);
+
+    c_total += c;
+    if(c >= threshold) {
+      out.write(key.data(), key.size(), c);
+      c_written += c;
     }
   }
 
-  if(!feof(src1) || !feof(src2))
-    throw string("Read error. All counts have been processed, but end of file has not been reached.");
-
-  rewind(out);
-  
+  out.close();
+  if(c_kept)
+    *c_kept = c_written;
   return c_total;
 }
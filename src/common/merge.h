@@ -26,8 +26,31 @@
 #ifndef merge_h
 #define merge_h
 
+#include <string>
+#include <vector>
+#include "CountStream.h"
+
 // Reads two sorted files of counts and merges them into an output
 // file with the counts added up.
 size_t mergeCounts(FILE* src1, FILE* src2, FILE* out);
 
+// Merges any number of sorted files of counts in the text format into
+// out in a single pass, adding up the counts of equal keys. If heads
+// isn't empty, heads[i] is the start of sources[i] which has been
+// read already. Returns the sum of all counts.
+long mergeCountsN(std::vector<FILE*>& sources, FILE* out,
+                  const std::vector<std::string>& heads = std::vector<std::string>());
+
+// Merges any number of sorted count streams in a single pass, adding
+// up the counts of equal keys. Only keys whose total count is at
+// least threshold are written; the sum of their counts is stored in
+// c_kept, if given. Returns the sum of all counts.
+long mergeCounts(std::vector<CountReader*>& sources, CountWriter& out,
+                 long threshold = 0, long* c_kept = NULL);
+
+// Merges sorted files in the binary chunk format (see ChunkFile.h)
+// into out, which is rewound afterwards. Blocks of out are compressed
+// if compress is set.
+long mergeChunkFiles(std::vector<FILE*>& sources, FILE* out, bool compress = false);
+
 #endif
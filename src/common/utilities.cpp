@@ -22,6 +22,10 @@
     You should have received a copy of the GNU Affero General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <errno.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <sys/resource.h>
 #include "utilities.h"
 
 using namespace std;
@@ -45,40 +49,6 @@ pcre* makePCRE(const char* expr, int options)
 }
 
 
-/*
-  NGRAMS
-*/
-
-long findchr(const char* str, char ch)
-{
-  const char* offset = strchr(str, ch);
-  if(offset == NULL)
-    return -1;
-  return (long)(offset - str);
-}
-
-char* deconstructCount(const char* str, char* ngram, long* count) 
-{
-  const long delimIndex = findchr(str, NGRAM_SEPARATOR);
-  if(delimIndex < 0)
-    return NULL;
-
-  // length until newline or end of string
-  long len = findchr(str, '\r'); 
-  if(len < 0)
-    len = findchr(str, '\n');
-  if(len < 0)
-    len = findchr(str, '\0');
-  if(len < 0)
-    return NULL;
-
-  strncpy(ngram, &str[delimIndex+1], len-delimIndex-1);
-  ngram[len-delimIndex-1] = '\0';
-  sscanf(str, "%ld", count);
-  return ngram;
-}
-
-
 /*
   TIME
 */
@@ -132,3 +102,66 @@ void words(char* str, vector<string>& vec)
   string buf = str;
   words(buf, vec);
 }
+
+
+/// Parses a number, or a range of numbers written MIN-MAX, into min
+/// and max. Returns false unless all of text is one of the two.
+bool parseRange(const char* text, long& min, long& max)
+{
+  char* end;
+  if(!isdigit((unsigned char)*text))
+    return false;
+  errno = 0;
+  min = max = strtol(text, &end, 10);
+  if(*end == '-') {
+    const char* start = end + 1;
+    if(!isdigit((unsigned char)*start))
+      return false;
+    max = strtol(start, &end, 10);
+  }
+  return *end == '\0' && errno == 0;
+}
+
+/// Parses a size in bytes, optionally followed by a unit: b (512
+/// bytes), k, m or g. Returns false unless all of text is a size.
+bool parseSize(const char* text, size_t& bytes)
+{
+  char* end;
+  if(!isdigit((unsigned char)*text))
+    return false;
+  errno = 0;
+  const unsigned long size = strtoul(text, &end, 10);
+  if(errno != 0 || (*end != '\0' && end[1] != '\0'))
+    return false;
+
+  switch(tolower(*end)) {
+  case 'b':
+    bytes = size*512;
+    return true;
+  case 'k':
+    bytes = size*1024;
+    return true;
+  case 'm':
+    bytes = size*1024*1024;
+    return true;
+  case 'g':
+    bytes = size*1024*1024*1024;
+    return true;
+  case '\0':
+    bytes = size;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Returns the maximum number of files, such as sorted runs, that can
+/// be open at once without running into the limit on open files
+size_t maxOpenFiles()
+{
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+    return 1024;
+  // leave room for stdin/stdout/stderr and the merged output
+  return limit.rlim_cur > 18 ? limit.rlim_cur - 16 : 2;
+}
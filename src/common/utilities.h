@@ -56,12 +56,13 @@ struct Error
 };
 
 pcre* makePCRE(const char* expr, int options);
-long findchr(const char* str, char ch);
-char* deconstructCount(const char* str, char* ngram, long* count);
 void eta(timespec start, unsigned int current, unsigned int total,
          unsigned int* hours, unsigned int* minutes, unsigned int* seconds);
 double readProgress(std::ifstream& file, long size);
 void words(std::string& str, std::vector<std::string>& vec);
 void words(char* str, std::vector<std::string>& vec);
+bool parseRange(const char* text, long& min, long& max);
+bool parseSize(const char* text, size_t& bytes);
+size_t maxOpenFiles();
 
 #endif // utilities_h
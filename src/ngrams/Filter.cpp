@@ -29,6 +29,8 @@
 #include <iostream>
 #include <string>
 #include "utilities.h"
+#include "LineIO.h"
+#include "CountStream.h"
 
 using namespace std;
 
@@ -42,7 +44,8 @@ private:
   bool header;
   bool hasTotal;
   FILE* tmpFile;
-  char* ngram;
+  LineWriter* out;
+  string line;
 
 public:
   CountFilter(long threshold, bool hasTotal)
@@ -53,35 +56,38 @@ public:
       tmpFile = tmpfile();
     else
       tmpFile = stdout;
+    out = new LineWriter(tmpFile);
     cBelow = cAbove = cExpectedTotal = 0;
     header = hasTotal;
-    ngram = new char[1024*1024];
   }
 
   ~CountFilter()
   {
-    delete ngram;
+    delete out;
     if(tmpFile != NULL && hasTotal)
       fclose(tmpFile);
   }
 
-  void filter(string line)
+  void filter(const char* data, size_t length)
   {
     if(header) {
+      line.assign(data, length);
       sscanf(line.c_str(), "%ld", &cExpectedTotal);
       header = false;
       return;
     }
     
     long c = 0;
-    if(!deconstructCount(line.c_str(), ngram, &c)) {
-      cerr << "WARNING: could not read ngram from input line:\n" << line << endl;
+    const char* ngram;
+    size_t ngramLength;
+    if(!parseCountLine(data, length, c, ngram, ngramLength)) {
+      cerr << "WARNING: could not read ngram from input line:\n" << string(data, length) << endl;
       return;
     }
 
     if(c >= threshold) {
-      fputs(line.c_str(), tmpFile);
-      fputc('\n', tmpFile);
+      out->write(data, length);
+      out->put('\n');
       cAbove += c;
     } else 
       cBelow += c;
@@ -93,22 +99,18 @@ public:
       cerr << "WARNING: actual number of ngrams does not match header: " << (cBelow + cAbove)
            << " vs. " << cExpectedTotal << endl;
     }
+    out->flush();
     if(hasTotal) {
-      fflush(tmpFile);
       rewind(tmpFile);
       printf("%ld\n", cAbove);
 
-      const size_t buf_size = 100*1024*1024;
+      const size_t buf_size = 1024*1024;
       char* buf = new char[buf_size];
-      while(true) {
-        char* read = fgets(buf, buf_size, tmpFile);
-        if(read)
-          fputs(buf, stdout);
-        else
-          break;
-      }
-
-      if(!feof(tmpFile)) {
+      size_t cRead;
+      while((cRead = fread(buf, 1, buf_size, tmpFile)) > 0)
+        fwrite(buf, 1, cRead, stdout);
+
+      if(ferror(tmpFile)) {
         delete[] buf;
         fclose(tmpFile);
         tmpFile = NULL;
@@ -117,6 +119,7 @@ public:
     
       delete[] buf;
       fclose(tmpFile);
+      fflush(stdout);
     }
     tmpFile = NULL;
   }
@@ -148,10 +151,12 @@ int main(int argc, const char** argv)
 
   CountFilter filter = CountFilter(threshold, hasTotal);
 
-  string line;
   try {
-    while(getline(cin, line)) {
-      filter.filter(line);
+    LineReader input(0);
+    const char* line;
+    size_t length;
+    while(input.next(line, length)) {
+      filter.filter(line, length);
     }
     filter.close();
   } catch(string err) {
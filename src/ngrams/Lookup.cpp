@@ -0,0 +1,155 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Lookup.cpp: looks up the counts of ngrams read from standard input
+                in a count file sorted by ngram, such as the output of
+                ngrams. Text files are memory-mapped and searched with
+                a sparse index (see CountFileView.cpp), so that a few
+                lookups in a large file don't require reading all of
+                it. Files in the indexed format (see IndexedFile.cpp)
+                are searched with their own index.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include "CountFileView.h"
+#include "IndexedFile.h"
+#include "LineIO.h"
+
+using namespace std;
+
+/// Whether key starts with prefix
+inline bool startsWith(const char* key, size_t length, const char* prefix, size_t prefixLength)
+{
+  return length >= prefixLength && memcmp(key, prefix, prefixLength) == 0;
+}
+
+/// Answers the queries of in with the counts of a text file
+void lookupText(const string& path, const string& indexPath, size_t stride, bool prefixes,
+                LineReader& in, CountWriter& out)
+{
+  CountFileView view(path, indexPath, stride);
+  const char* query;
+  size_t length;
+  while(in.next(query, length)) {
+    if(length > 0 && query[length-1] == '\r')
+      length--;
+
+    if(prefixes) {
+      CountRangeReader range = view.prefixRange(query, length);
+      while(range.next())
+        out.write(range.key(), range.keyLength(), range.count());
+    } else {
+      // missing ngrams have a count of 0, so that the output lines
+      // up with the queries
+      long count = 0;
+      view.lookup(query, length, count);
+      out.write(query, length, count);
+    }
+  }
+}
+
+/// Answers the queries of in with the counts of an indexed file
+void lookupIndexed(FILE* file, bool prefixes, LineReader& in, CountWriter& out)
+{
+  IndexedReader reader(file);
+  const char* query;
+  size_t length;
+  while(in.next(query, length)) {
+    if(length > 0 && query[length-1] == '\r')
+      length--;
+
+    if(prefixes) {
+      if(!reader.seek(query, length))
+        continue;
+      while(reader.next() && startsWith(reader.key(), reader.keyLength(), query, length))
+        out.write(reader.key(), reader.keyLength(), reader.count());
+    } else {
+      long count = 0;
+      reader.lookup(query, length, count);
+      out.write(query, length, count);
+    }
+  }
+}
+
+void printUsage(const char* name)
+{
+  printf("Usage: %s [-p] [-i INDEX] [-s STRIDE] FILE\n", name);
+}
+
+int main(int argc, const char** argv)
+{
+  bool prefixes = false;
+  string indexPath;
+  long stride = 64;
+  string path;
+
+  for(int i=1; i<argc; i++) {
+    if(strcmp("-p", argv[i]) == 0) {
+      prefixes = true;
+    }
+    else if(strcmp("-i", argv[i]) == 0 && i<argc-1) {
+      indexPath = argv[++i];
+    }
+    else if(strcmp("-s", argv[i]) == 0 && i<argc-1) {
+      stride = atol(argv[++i]);
+    }
+    else if(argv[i][0] != '-' && path.empty()) {
+      path = argv[i];
+    }
+    else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(path.empty() || stride <= 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  FILE* file = fopen(path.c_str(), "rb");
+  if(file == NULL) {
+    cerr << "Error opening file " << path << endl;
+    return 1;
+  }
+
+  try {
+    LineReader queries(stdin);
+    TextCountWriter out(stdout);
+    if(IndexedReader::isIndexed(file))
+      lookupIndexed(file, prefixes, queries, out);
+    else
+      lookupText(path, indexPath, stride, prefixes, queries, out);
+    out.close();
+  } catch(string err) {
+    cerr << err << endl;
+    fclose(file);
+    return 1;
+  }
+
+  fclose(file);
+  return 0;
+}
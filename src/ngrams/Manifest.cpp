@@ -0,0 +1,110 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Manifest.cpp: reads and writes the manifest of an ngram counting
+                  job run with a work directory. The manifest is a
+                  small text file which lists the chunks written so
+                  far and how much input they cover, so that an
+                  interrupted job can be resumed. It's always written
+                  to a temporary file first and renamed over the old
+                  one, so a crash leaves either the old or the new
+                  manifest behind.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "Manifest.h"
+
+using namespace std;
+
+const char* MANIFEST_MAGIC = "ngrams-manifest";
+const int MANIFEST_VERSION = 3;
+
+void Manifest::write(const string& path) const
+{
+  const string tmpPath = path + ".tmp";
+  FILE* file = fopen(tmpPath.c_str(), "w");
+  if(file == NULL)
+    throw string("Could not write ") + tmpPath + ": " + strerror(errno);
+
+  fprintf(file, "%s %d\n", MANIFEST_MAGIC, MANIFEST_VERSION);
+  fprintf(file, "orders %d %d\n", minN, maxN);
+  fprintf(file, "skip %d\n", skip);
+  fprintf(file, "input %lld %lld %s\n", inputSize, inputTime, input.c_str());
+  fprintf(file, "offset %ld\n", offset);
+  fprintf(file, "next-chunk %lu\n", (unsigned long)nextChunk);
+  fprintf(file, "totals");
+  for(size_t i=0; i<totals.size(); i++)
+    fprintf(file, " %ld", totals[i]);
+  fprintf(file, "\n");
+  for(size_t i=0; i<chunks.size(); i++)
+    fprintf(file, "chunk %s %d\n", chunks[i].c_str(), levels[i]);
+
+  bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = (fclose(file) == 0) && ok;
+  if(!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+    throw string("Could not write ") + path + ": " + strerror(errno);
+}
+
+bool Manifest::read(const string& path)
+{
+  FILE* file = fopen(path.c_str(), "r");
+  if(file == NULL)
+    return false;
+
+  const string error = string("Invalid manifest: ") + path;
+  char magic[32];
+  int version;
+  unsigned long next;
+  char inputPath[4096];
+  bool ok = fscanf(file, "%31s %d", magic, &version) == 2
+    && strcmp(magic, MANIFEST_MAGIC) == 0 && version == MANIFEST_VERSION
+    && fscanf(file, " orders %d %d", &minN, &maxN) == 2 && minN > 0 && maxN >= minN
+    && fscanf(file, " skip %d", &skip) == 1 && skip >= 0
+    && fscanf(file, " input %lld %lld %4095[^\n]", &inputSize, &inputTime, inputPath) == 3
+    && fscanf(file, " offset %ld", &offset) == 1
+    && fscanf(file, " next-chunk %lu", &next) == 1
+    && fscanf(file, " totals") == 0;
+  nextChunk = next;
+  if(ok)
+    input = inputPath;
+
+  totals.assign(ok ? maxN-minN+1 : 0, 0);
+  for(size_t i=0; ok && i<totals.size(); i++)
+    ok = fscanf(file, " %ld", &totals[i]) == 1;
+
+  chunks.clear();
+  levels.clear();
+  char name[256];
+  int level;
+  while(ok && fscanf(file, " chunk %255s %d", name, &level) == 2) {
+    chunks.push_back(name);
+    levels.push_back(level);
+  }
+  ok = ok && feof(file);
+  fclose(file);
+
+  if(!ok)
+    throw error;
+  return true;
+}
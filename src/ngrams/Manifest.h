@@ -0,0 +1,59 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Manifest.h: see Manifest.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef Manifest_h
+#define Manifest_h
+
+#include <string>
+#include <vector>
+
+/** The state of an ngram counting job at a checkpoint: how much of
+    the input has been counted, and the chunks holding the counts. */
+struct Manifest
+{
+  int minN;
+  int maxN;
+  int skip;                 // of skip-grams, or 0 for ngrams
+  std::string input;        // canonical path of the input file, or "-" for stdin
+  long long inputSize;      // of the input file, when it was first counted
+  long long inputTime;      // modification time of the input file
+  long offset;              // bytes of input counted
+  size_t nextChunk;         // number of the next chunk file
+  std::vector<long> totals; // by order, from minN to maxN
+  std::vector<std::string> chunks; // file names, relative to the work directory
+  std::vector<int> levels;  // how many merges produced each chunk
+
+  Manifest() : minN(0), maxN(0), skip(0), input("-"), inputSize(0), inputTime(0), offset(0),
+               nextChunk(0) { }
+
+  /** Replaces the manifest at path atomically. Throws a string on
+      errors. */
+  void write(const std::string& path) const;
+
+  /** Reads a manifest. Returns false if there is none, and throws a
+      string if it can't be parsed. */
+  bool read(const std::string& path);
+};
+
+#endif // Manifest_h
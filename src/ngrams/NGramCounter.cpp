@@ -12,9 +12,22 @@
 
                       NGramCounter uses a disk cache to store intermediate
                       results. The intermediate results are stored in 
-                      temporary files called "chunks", which NGramCounter
-                      periodically merges in a manner similar to a 2-way
-                      merge sort.
+                      temporary files called "chunks" (in the binary
+                      format of ChunkFile.h), which NGramCounter
+                      merges in a single k-way pass at the end. Only when
+                      the number of chunks would exceed the merge fan-in
+                      are some of them merged early.
+
+                      With -j N, the input is counted by N threads. The
+                      ngrams are hash-partitioned into N shards, each
+                      with its own table and chunks, so the output is
+                      the same as when counting with a single thread.
+
+                      With --work-dir, chunks are named files instead,
+                      and a manifest (see Manifest.cpp) records which
+                      chunks hold the counts of how much input. A job
+                      interrupted after such a checkpoint can be
+                      resumed with --resume.
     
 
 
@@ -35,19 +48,32 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdlib.h>
+#include <limits.h>
 #include <ctype.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
 #include <iostream>
+#include <algorithm>
+#include <queue>
 #include "string.h"
 #include "NGramCounter.h"
 #include "utilities.h"
 #include "merge.h"
+#include "ChunkFile.h"
+#include "IndexedFile.h"
+#include "TopCounts.h"
+#include "Manifest.h"
 
 
 using namespace std;
 
-bool isAllWhitespace(string str)
+bool isAllWhitespace(const char* str, size_t length)
 {
-  for(size_t i=0; i<str.size(); i++) {
+  for(size_t i=0; i<length; i++) {
     char ch = str[i];
     if(ch != ' ' && ch != '\n' && ch != '\r' && ch != '\f' && ch != '\t')
       return false;
@@ -55,266 +81,1321 @@ bool isAllWhitespace(string str)
   return true;
 }
 
-NGramCounter::NGramCounter(const int n, const size_t maxChunkSize, const bool verbose) {
-  this->n = n;
+const size_t BATCH_SIZE = 1024*1024; // bytes of input per batch of lines
+const size_t PENDING_SIZE = 64*1024; // bytes of ngrams added to a shard at once
+
+/// Lines read in one go, stored back to back
+struct LineBatch
+{
+  string text;
+  vector<size_t> ends; // end of each line within text
+};
+
+/// Bounded queue of line batches handed from the reading thread to
+/// the counting threads
+class LineBatchQueue
+{
+ private:
+  queue<LineBatch*> batches;
+  size_t capacity;
+  bool closed;
+  boost::mutex mutex;
+  boost::condition_variable changed;
+
+ public:
+  LineBatchQueue(size_t capacity) : capacity(capacity), closed(false) { }
+
+  void push(LineBatch* batch)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while(batches.size() >= capacity)
+      changed.wait(lock);
+    batches.push(batch);
+    changed.notify_all();
+  }
+
+  /// Returns the next batch, or NULL once the queue is closed and empty
+  LineBatch* pop()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while(batches.empty() && !closed)
+      changed.wait(lock);
+    if(batches.empty())
+      return NULL;
+
+    LineBatch* batch = batches.front();
+    batches.pop();
+    changed.notify_all();
+    return batch;
+  }
+
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    closed = true;
+    changed.notify_all();
+  }
+};
+
+/// Sorts a table of interned ngrams by their words. Word IDs are
+/// replaced by the ranks of the words, so the usual memcmp() sort
+/// applies.
+void sortInterned(NGramTable& table, Vocabulary& vocabulary, WordOrder& order)
+{
+  vocabulary.order(order);
+  table.rewriteKeys([&order](char* key, size_t length) {
+      order.encode(key+1, (length-1) / sizeof(uint32_t));
+    });
+  table.sort();
+}
+
+/// Reads the counts of a table sorted by sortInterned() in order,
+/// turning each ngram back into a string
+class InternedTableReader : public CountReader
+{
+ private:
+  const NGramTable* table;
+  WordOrder order;
+  TupleJoiner joiner;
+  size_t index;
+
+ public:
+  InternedTableReader(NGramTable* table, Vocabulary* vocabulary)
+    : table(table), joiner(*vocabulary, order, 1), index(0)
+  {
+    sortInterned(*table, *vocabulary, order);
+  }
+
+  void rewind() { index = 0; }
+
+  bool next()
+  {
+    if(index >= table->size())
+      return false;
+
+    const NGramTable::Entry& entry = (*table)[index++];
+    const string& ngram = joiner.join(table->key(entry), entry.length);
+    currentKey = ngram.data();
+    currentLength = ngram.size();
+    currentCount = entry.count;
+    return true;
+  }
+};
+
+/// Picks the output partition of an ngram. FNV-1a of the ngram's
+/// words, so that partitions match no matter how the ngrams were
+/// counted.
+size_t partitionOf(const char* ngram, size_t length, size_t partitions)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for(size_t i=0; i<length; i++) {
+    h ^= (unsigned char)ngram[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h % partitions;
+}
+
+/// Writes the counts of each order to a separate output, or to one
+/// of its hash partitions, stripping the order from the keys. Unless
+/// top is 0, only the top most frequent ngrams of each output are
+/// written, most frequent first. Otherwise the outputs are in the
+/// text format, or in the indexed format if indexed is set. Counts
+/// of NULL outputs are only added to the totals.
+class OrderCountWriter : public CountWriter
+{
+ private:
+  vector<CountWriter*> writers; // by order and partition
+  size_t partitions;
+
+ public:
+  vector<long> totals; // sum of the counts written to each output
+
+  OrderCountWriter(const vector<FILE*>& outputs, size_t partitions, size_t top, bool indexed)
+    : partitions(partitions), totals(outputs.size(), 0)
+  {
+    for(size_t i=0; i<outputs.size(); i++) {
+      if(outputs[i] == NULL)
+        writers.push_back(NULL);
+      else if(top > 0)
+        writers.push_back(new TopCountWriter(outputs[i], top));
+      else if(indexed)
+        writers.push_back(new IndexedWriter(outputs[i]));
+      else
+        writers.push_back(new TextCountWriter(outputs[i]));
+    }
+  }
+
+  ~OrderCountWriter()
+  {
+    for(size_t i=0; i<writers.size(); i++)
+      delete writers[i];
+  }
+
+  void write(const char* key, size_t length, long count)
+  {
+    size_t output = (unsigned char)key[0] * partitions;
+    if(partitions > 1)
+      output += partitionOf(key+1, length-1, partitions);
+    if(writers[output])
+      writers[output]->write(key+1, length-1, count);
+    totals[output] += count;
+  }
+
+  void close()
+  {
+    for(size_t i=0; i<writers.size(); i++) {
+      if(writers[i])
+        writers[i]->close();
+    }
+  }
+};
+
+/// Appends the word offsets of every skip-gram of k words which skips
+/// at most skip words in total, and starts with the given offsets, to
+/// all.
+void addSkipOffsets(size_t k, size_t skip, vector<size_t>& offsets, vector<size_t>& all)
+{
+  if(offsets.size() == k) {
+    all.insert(all.end(), offsets.begin(), offsets.end());
+    return;
+  }
+
+  const size_t skipped = offsets.back() + 1 - offsets.size();
+  for(size_t gap=0; skipped + gap <= skip; gap++) {
+    offsets.push_back(offsets.back() + 1 + gap);
+    addSkipOffsets(k, skip, offsets, all);
+    offsets.pop_back();
+  }
+}
+
+NGramCounter::NGramCounter(const NGramOptions& options) {
+  const int numShards = options.threads;
+  this->minN = options.minN;
+  this->maxN = options.maxN;
+  this->skip = options.skip;
+  this->outputPrefix = options.outputPrefix;
   this->closed = false;
-  this->maxChunkSize = maxChunkSize;
+  this->maxChunkSize = options.maxChunkSize;
+  this->vocabulary = options.intern ? new Vocabulary() : NULL;
+  this->verbose = options.verbose;
+  this->compress = options.compress;
+  this->workDir = options.workDir;
+  this->partitions = max(options.partitions, (size_t)1);
+  this->threshold = options.threshold;
+  this->top = options.top;
+  this->indexed = options.indexed;
+  this->nextChunk = 0;
+  this->inputOffset = 0;
+  this->resumeOffset = 0;
+  this->checkpointOffset = 0;
+  this->input = "-";
+  this->inputSize = 0;
+  this->inputTime = 0;
+
+  size_t maxFanIn = min(max(options.fanIn, (size_t)2), maxOpenFiles());
+  if(maxFanIn < options.fanIn)
+    cerr << "WARNING: merge fan-in limited to " << maxFanIn << " by the open files limit." << endl;
+  this->fanIn = max(maxFanIn / numShards, (size_t)2);
+
+  // open the outputs up front, so that a bad path is reported before
+  // all the counting
+  outputs.resize((maxN+1)*partitions, NULL);
+  for(int k=minN; k<=maxN; k++) {
+    for(size_t p=0; p<partitions; p++) {
+      const size_t i = k*partitions + p;
+      if(outputPrefix.empty())
+        outputs[i] = stdout;
+      else if((outputs[i] = fopen(outputPath(k, p).c_str(), "w")) == NULL)
+        throw string("Could not open ") + outputPath(k, p) + " for writing.";
+    }
+  }
+
+  for(int i=0; i<numShards; i++)
+    shards.push_back(new NGramShard(maxN));
+
+  if(skip > 0) {
+    skipOffsets.resize(maxN+1);
+    for(int k=minN; k<=maxN; k++) {
+      vector<size_t> offsets(1, 0);
+      addSkipOffsets(k, skip, offsets, skipOffsets[k]);
+    }
+  }
+
+  if(options.approximate > 0) {
+    if(numShards > 1)
+      throw string("Approximate counting is single-threaded.");
+    summaries.resize(maxN+1, NULL);
+    for(int k=minN; k<=maxN; k++)
+      summaries[k] = new SpaceSaving(options.approximate);
+  }
+  scratch.pending.resize(numShards);
+
+  if(!workDir.empty()) {
+    if(mkdir(workDir.c_str(), 0777) != 0 && errno != EEXIST)
+      throw string("Could not create ") + workDir + ": " + strerror(errno);
 
-  // an approximation of how many bytes of input
-  // we can store in a chunk without going over maxChunkSize
-  // Disclaimer: 2n because we store each ngram twice: as a key in
-  // the hashmap and as a member in the sorted set. 8 because
-  // we store a long count for each. The constant '4' is empirical.
-  this->maxChunkLength = 4*maxChunkSize / (2*n+8);
-  this->chunkLength = 0;
-  this->currentCounts.rehash(this->maxChunkLength / 6);
-  this->totalCount = 0;
-  this->verbose = verbose;
+    // the manifest identifies the input by its path, size and
+    // modification time, so that a checkpoint isn't resumed with
+    // another input. Stdin can only be checked by its length.
+    if(!options.inputPath.empty()) {
+      char* resolved = realpath(options.inputPath.c_str(), NULL);
+      struct stat info;
+      if(resolved == NULL || stat(resolved, &info) != 0) {
+        free(resolved);
+        throw string("Could not open ") + options.inputPath + ": " + strerror(errno);
+      }
+      input = resolved;
+      free(resolved);
+      inputSize = info.st_size;
+      inputTime = info.st_mtime;
+    }
+
+    if(options.resume)
+      resume();
+    else if(access((workDir + "/manifest").c_str(), F_OK) == 0)
+      throw workDir + " holds a checkpoint. Resume it with --resume, or remove it.";
+    else if(size_t removed = removeUnlisted(vector<string>()))
+      cerr << "WARNING: removed " << removed << " chunks left in " << workDir
+           << " by a job interrupted before its first checkpoint." << endl;
+  }
 }
 
 NGramCounter::~NGramCounter()
 {
+  for(size_t i=0; i<shards.size(); i++) {
+    if(shards[i]->spiller.joinable())
+      shards[i]->spiller.join();
+    delete shards[i];
+  }
+  for(size_t k=0; k<summaries.size(); k++)
+    delete summaries[k];
+  delete vocabulary;
+
+  if(!closed) {
+    for(size_t i=0; i<outputs.size(); i++) {
+      if(outputs[i] != NULL && outputs[i] != stdout)
+        fclose(outputs[i]);
+    }
+  }
+}
+
+/// Returns the path of the output file for ngrams of order k, or of
+/// partition p of them
+string NGramCounter::outputPath(int k, size_t p)
+{
+  char suffix[48];
+  if(partitions > 1)
+    sprintf(suffix, ".%d.%lu", k, (unsigned long)p);
+  else
+    sprintf(suffix, ".%d", k);
+  return outputPrefix + suffix;
 }
 
-void NGramCounter::endChunk()
+/// Picks the shard of an ngram. Uses the high bits of the hash, the
+/// low ones pick the slot within the shard's table.
+size_t NGramCounter::shardOf(uint64_t hash)
 {
-  // Create chunk file and write out the ngrams
-  FILE* chunkFile = tmpfile();
-  if(chunkFile == NULL)
-    throw string("ERROR: could not create chunk file. Possibly too many chunks? Try increasing chunk size.");
-  
-  for(set<string>::iterator it = sortedNGrams.begin(); it != sortedNGrams.end(); it++) {
-    string ngram = *it;
-    long count = currentCounts[ngram];
-    fprintf(chunkFile, "%ld%c%s\n", count, NGRAM_SEPARATOR, ngram.c_str());
-  }  
-  fflush(chunkFile);
-  rewind(chunkFile);
-  
-  // Clean state for next chunk
-  sortedNGrams.clear();  
-  currentCounts.clear();
-  chunkLength = 0;
-  
-  chunkFiles.push_back(chunkFile);
+  return (size_t)(((hash >> 32) * shards.size()) >> 32);
+}
 
-  if(chunkFiles.size() >= 3) {
-    // This ensures we have at most 3 chunks at any time.
-    // This is because an excessive number of chunks can strain
-    // system resources, and calls to tmpfile might fail.
-    FILE* merged = mergeChunks(chunkFiles[0], chunkFiles[1], false);
-    chunkFiles.erase(chunkFiles.begin()+1);
-    chunkFiles.erase(chunkFiles.begin());
-    chunkFiles.push_back(merged);
+/// Sorts a table, writes it out as a chunk and clears it. Returns the
+/// sum of the written counts.
+long NGramCounter::writeTable(NGramTable& table, FILE* out)
+{
+  // the table is only sorted once per chunk, right before it's written out
+  long c_total = 0;
+  ChunkWriter writer(out, compress);
+  if(vocabulary) {
+    // interned ngrams are only turned back into strings here
+    WordOrder order;
+    sortInterned(table, *vocabulary, order);
+    TupleJoiner joiner(*vocabulary, order, 1);
+    for(size_t i=0; i<table.size(); i++) {
+      const NGramTable::Entry& entry = table[i];
+      const string& ngram = joiner.join(table.key(entry), entry.length);
+      writer.write(ngram.data(), ngram.size(), entry.count);
+      c_total += entry.count;
+    }
+  } else {
+    table.sort();
+    for(size_t i=0; i<table.size(); i++) {
+      const NGramTable::Entry& entry = table[i];
+      writer.write(table.key(entry), entry.length, entry.count);
+      c_total += entry.count;
+    }
   }
+  writer.close();
+  table.clear();
+  return c_total;
+}
+
+/// Returns how many bytes each table may use: an even share of the
+/// memory limit, less what the vocabulary holds. Each shard has two
+/// tables, one of which may be being spilled. main() makes sure the
+/// limit leaves every table at least NGramTable::minBytes(), so the
+/// floor only matters once the vocabulary outgrows the limit.
+size_t NGramCounter::tableBudget()
+{
+  size_t vocabularyBytes = vocabulary ? vocabulary->bytes() : 0;
+  size_t budget = 0;
+  if(vocabularyBytes < maxChunkSize)
+    budget = (maxChunkSize - vocabularyBytes) / (2*shards.size());
+  return max(budget, NGramTable::minBytes());
 }
 
-void NGramCounter::count(const string line)
+/// Spills the table of a shard unless length more bytes of ngrams
+/// fit in its share of memory. Must be called with the shard locked.
+void NGramCounter::checkMemory(NGramShard* shard, size_t length)
+{
+  shard->table.setMaxBytes(tableBudget());
+  // without threads, every spill covers all input read so far
+  if(shard->table.isFull() || !shard->table.fits(length))
+    endChunk(shard, !workDir.empty() && shards.size() == 1);
+}
+
+/// Hands the table of a shard over to a background thread, which
+/// spills it, and carries on counting in the spare table. Only waits
+/// if the previous spill of the shard is still running. With
+/// checkpoint set, the spilled chunk covers all input read so far and
+/// the manifest is updated once it's written.
+void NGramCounter::endChunk(NGramShard* shard, bool checkpoint)
+{
+  waitForSpill(shard);
+  if(checkpoint) {
+    checkpointOffset = inputOffset;
+    checkpointTotals = shard->totalCounts;
+  }
+  shard->table.swap(shard->spare);
+  shard->spiller = boost::thread([this, shard, checkpoint]() { spill(shard, checkpoint); });
+}
+
+/// Writes the spare table of a shard out as a chunk, and merges
+/// chunks if there are too many. Runs in the background.
+void NGramCounter::spill(NGramShard* shard, bool checkpoint)
+{
+  try {
+    string name;
+    FILE* chunkFile = newChunk(name);
+    writeTable(shard->spare, chunkFile);
+    syncChunk(chunkFile);
+    rewind(chunkFile);
+
+    shard->chunkFiles.push_back(chunkFile);
+    shard->chunkLevels.push_back(0);
+    shard->chunkNames.push_back(name);
+
+    if(shard->chunkFiles.size() >= fanIn)
+      compactChunks(shard);
+
+    if(checkpoint) {
+      writeManifest(checkpointOffset, checkpointTotals);
+      removeObsolete();
+    }
+  } catch(string err) {
+    shard->spillError = err;
+  }
+}
+
+/// Waits for the background spill of a shard, if any, to finish
+void NGramCounter::waitForSpill(NGramShard* shard)
+{
+  if(shard->spiller.joinable())
+    shard->spiller.join();
+  if(!shard->spillError.empty())
+    throw shard->spillError;
+}
+
+/// Creates a chunk file: a named one in the work directory, or an
+/// anonymous temporary file
+FILE* NGramCounter::newChunk(string& name)
+{
+  if(workDir.empty()) {
+    name.clear();
+    FILE* file = tmpfile();
+    if(file == NULL)
+      throw string("ERROR: could not create chunk file. Possibly too many chunks? Try increasing chunk size.");
+    return file;
+  }
+
+  char number[32];
+  {
+    boost::lock_guard<boost::mutex> lock(chunkMutex);
+    sprintf(number, "chunk-%lu", (unsigned long)nextChunk++);
+  }
+  name = number;
+  FILE* file = fopen((workDir + "/" + name).c_str(), "w+b");
+  if(file == NULL)
+    throw string("Could not create chunk file ") + workDir + "/" + name + ": " + strerror(errno);
+  return file;
+}
+
+/// Makes sure a chunk in the work directory survives a crash before
+/// a manifest refers to it
+void NGramCounter::syncChunk(FILE* chunk)
+{
+  if(!workDir.empty() && (fflush(chunk) != 0 || fsync(fileno(chunk)) != 0))
+    throw string("Could not write chunk file: ") + strerror(errno);
+}
+
+/// Records the chunks of all shards in the manifest, as the counts
+/// of the first offset bytes of input
+void NGramCounter::writeManifest(long offset, const vector<long>& totals)
+{
+  Manifest manifest;
+  manifest.minN = minN;
+  manifest.maxN = maxN;
+  manifest.skip = skip;
+  manifest.input = input;
+  manifest.inputSize = inputSize;
+  manifest.inputTime = inputTime;
+  manifest.offset = offset;
+  manifest.totals.assign(totals.begin() + minN, totals.end());
+  {
+    boost::lock_guard<boost::mutex> lock(chunkMutex);
+    manifest.nextChunk = nextChunk;
+  }
+  for(size_t s=0; s<shards.size(); s++) {
+    NGramShard* shard = shards[s];
+    manifest.chunks.insert(manifest.chunks.end(), shard->chunkNames.begin(), shard->chunkNames.end());
+    manifest.levels.insert(manifest.levels.end(), shard->chunkLevels.begin(), shard->chunkLevels.end());
+  }
+  manifest.write(workDir + "/manifest");
+}
+
+/// Deletes the chunks which were merged into others. They're kept
+/// until a manifest no longer refers to them.
+void NGramCounter::removeObsolete()
+{
+  for(size_t s=0; s<shards.size(); s++) {
+    vector<string>& obsolete = shards[s]->obsolete;
+    for(size_t i=0; i<obsolete.size(); i++)
+      unlink((workDir + "/" + obsolete[i]).c_str());
+    obsolete.clear();
+  }
+}
+
+/// Deletes the chunk files of the work directory which aren't in
+/// chunks, such as those written after the last checkpoint. Returns
+/// how many were deleted.
+size_t NGramCounter::removeUnlisted(const vector<string>& chunks)
+{
+  size_t removed = 0;
+  DIR* dir = opendir(workDir.c_str());
+  if(dir != NULL) {
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+      const string name = entry->d_name;
+      if(name.compare(0, 6, "chunk-") == 0
+         && find(chunks.begin(), chunks.end(), name) == chunks.end()
+         && unlink((workDir + "/" + name).c_str()) == 0)
+        removed++;
+    }
+    closedir(dir);
+  }
+  return removed;
+}
+
+/// Spills all shards and records them in the manifest. Only called
+/// when no lines are being counted.
+void NGramCounter::checkpoint()
+{
+  for(size_t s=0; s<shards.size(); s++) {
+    if(shards[s]->table.size() > 0)
+      endChunk(shards[s], false);
+  }
+
+  vector<long> totals(maxN+1, 0);
+  for(size_t s=0; s<shards.size(); s++) {
+    waitForSpill(shards[s]);
+    for(int k=minN; k<=maxN; k++)
+      totals[k] += shards[s]->totalCounts[k];
+  }
+
+  writeManifest(inputOffset, totals);
+  removeObsolete();
+  if(verbose)
+    cerr << "Checkpoint at " << inputOffset << " bytes of input." << endl;
+}
+
+/// Picks up the chunks and totals of an interrupted job from the
+/// manifest. Chunks written after the last checkpoint are deleted.
+void NGramCounter::resume()
+{
+  Manifest manifest;
+  if(!manifest.read(workDir + "/manifest"))
+    throw string("Nothing to resume: no manifest in ") + workDir;
+  if(manifest.minN != minN || manifest.maxN != maxN)
+    throw string("Cannot resume: the checkpoint in ") + workDir + " counts different ngram sizes.";
+  if(manifest.skip != skip)
+    throw string("Cannot resume: the checkpoint in ") + workDir + " counts a different skip.";
+  // standard input can be anything, so only a file is checked
+  if(manifest.input != "-" && manifest.input != input)
+    throw string("Cannot resume: the checkpoint in ") + workDir + " counts " + manifest.input + ".";
+  if(manifest.input != "-" && (manifest.inputSize != inputSize || manifest.inputTime != inputTime))
+    throw string("Cannot resume: ") + input + " changed since the checkpoint in " + workDir + ".";
+
+  for(size_t i=0; i<manifest.chunks.size(); i++) {
+    const string path = workDir + "/" + manifest.chunks[i];
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL)
+      throw string("Could not open chunk file ") + path + ": " + strerror(errno);
+
+    // chunks are merged together at the end anyway, so any shard will do
+    NGramShard* shard = shards[i % shards.size()];
+    shard->chunkFiles.push_back(file);
+    shard->chunkLevels.push_back(manifest.levels[i]);
+    shard->chunkNames.push_back(manifest.chunks[i]);
+  }
+  for(int k=minN; k<=maxN; k++)
+    shards[0]->totalCounts[k] = manifest.totals[k-minN];
+  nextChunk = manifest.nextChunk;
+  resumeOffset = manifest.offset;
+
+  removeUnlisted(manifest.chunks);
+
+  if(verbose)
+    cerr << "Resuming after " << resumeOffset << " bytes of input and "
+         << manifest.chunks.size() << " chunks." << endl;
+}
+
+/// Merges the smallest chunks of a shard into one, so that no more
+/// than fanIn chunks exist at any time. Chunks are merged level by
+/// level: the lowest levels are merged once they hold at least half
+/// of all chunks, so each ngram is only rewritten about
+/// log(chunks)/log(fanIn/2) times.
+void NGramCounter::compactChunks(NGramShard* shard)
+{
+  vector<FILE*>& chunkFiles = shard->chunkFiles;
+  vector<int>& chunkLevels = shard->chunkLevels;
+  vector<string>& chunkNames = shard->chunkNames;
+
+  int level = 0;
+  while(true) {
+    size_t count = 0;
+    for(size_t i=0; i<chunkLevels.size(); i++)
+      count += (chunkLevels[i] <= level);
+    if(count >= max(fanIn/2, (size_t)2))
+      break;
+    level++;
+  }
+
+  vector<FILE*> merging, remaining;
+  vector<int> remainingLevels;
+  vector<string> remainingNames;
+  for(size_t i=0; i<chunkFiles.size(); i++) {
+    if(chunkLevels[i] <= level) {
+      merging.push_back(chunkFiles[i]);
+      if(!chunkNames[i].empty())
+        shard->obsolete.push_back(chunkNames[i]);
+    } else {
+      remaining.push_back(chunkFiles[i]);
+      remainingLevels.push_back(chunkLevels[i]);
+      remainingNames.push_back(chunkNames[i]);
+    }
+  }
+
+  if(verbose)
+    cerr << "Merging " << merging.size() << " chunks up to level " << level << endl;
+
+  string mergedName;
+  FILE* merged = newChunk(mergedName);
+
+  // merged is yet another chunk that we'll have to merge. It's
+  // rewound so that future reads start from the beginning.
+  mergeChunkFiles(merging, merged, compress);
+  syncChunk(merged);
+  for(size_t i=0; i<merging.size(); i++)
+    fclose(merging[i]);
+
+  chunkFiles = remaining;
+  chunkLevels = remainingLevels;
+  chunkNames = remainingNames;
+  chunkFiles.push_back(merged);
+  chunkLevels.push_back(level+1);
+  chunkNames.push_back(mergedName);
+}
+
+void NGramCounter::count(const char* line, size_t length)
 {
   if(closed)
     throw string("NGramCounter is closed.");
-  else if(isAllWhitespace(line))
+  else if(isAllWhitespace(line, length))
     return;
 
-  ngrams(line, &lineNGrams);
-  for(vector<string>::iterator it = lineNGrams.begin(); it < lineNGrams.end(); it++) {
-    currentCounts[*it] += 1;
-    sortedNGrams.insert(*it);
-    totalCount++;
+  if(!summaries.empty()) {
+    NGramShard* shard = shards[0];
+    forEachNGram(line, length, scratch, [this, shard](const char* key, size_t length, uint64_t hash) {
+        summaries[(unsigned char)key[0]]->add(key, length, hash);
+        shard->totalCounts[(unsigned char)key[0]]++;
+      });
+    return;
   }
 
-  chunkLength += (line.length()+1); // +1 for the newline
-  if(chunkLength > maxChunkLength) {
-    endChunk();
+  if(shards.size() == 1) {
+    NGramShard* shard = shards[0];
+    forEachNGram(line, length, scratch, [shard](const char* key, size_t length, uint64_t hash) {
+        shard->table.add(key, length, hash, 1);
+        shard->totalCounts[(unsigned char)key[0]]++;
+      });
+    // the ngrams of the next line are usually much smaller than this
+    checkMemory(shard, PENDING_SIZE);
+    return;
   }
+
+  forEachNGram(line, length, scratch, [this](const char* key, size_t length, uint64_t hash) {
+      route(key, length, hash, scratch.pending);
+    });
+  flush(scratch.pending, true);
 }
 
-void NGramCounter::printOnlyChunk()
+/// Calls add(key, length, hash) for each ngram of each order in a
+/// line. Ngrams are either strings, or tuples of word IDs when
+/// interning, prefixed with their order.
+template<class Add>
+void NGramCounter::forEachNGram(const char* line, size_t length, NGramScratch& scratch, Add add)
 {
-  if(chunkFiles.size() != 1)
-    throw string("printOnlyChunk: invalid number of chunks");
+  if(skip > 0) {
+    forEachSkipGram(line, length, scratch, add);
+    return;
+  }
 
-  const size_t buf_size = 10*1024*1024; // 10MB
-  char* buf = new char[buf_size];
-  char* ngram = new char[buf_size];
-  printf("%ld\n", totalCount); // total no. of ngrams
+  if(vocabulary) {
+    // ids are padded for maxN, so lower orders skip some of the padding
+    wordIds(line, length, scratch.words, scratch.ids);
+    string& key = scratch.key;
+    for(int k=minN; k<=maxN; k++) {
+      const size_t keyLength = 1 + k*sizeof(uint32_t);
+      key.resize(keyLength);
+      key[0] = (char)k;
+      for(size_t i=maxN-k; i+k <= scratch.ids.size(); i++) {
+        memcpy(&key[1], &scratch.ids[i], k*sizeof(uint32_t));
+        add(key.data(), keyLength, hashWordIds(&scratch.ids[i], k));
+      }
+    }
+    return;
+  }
 
-  long c = 0;
-  long c_total = 0;
-  while(fgets(buf, buf_size, chunkFiles[0])) {
-    cout << buf;
-    deconstructCount(buf, ngram, &c);
-    c_total += c;
+  // every ngram is a range of the padded text. It's only copied to
+  // put its order in front.
+  paddedText(line, length, scratch.words, scratch.text, scratch.spans);
+  const vector<WordSpan>& spans = scratch.spans;
+  string& key = scratch.key;
+  for(int k=minN; k<=maxN; k++) {
+    for(size_t i=maxN-k; i+k <= spans.size(); i++) {
+      const size_t start = spans[i].first;
+      const size_t end = spans[i+k-1].first + spans[i+k-1].second;
+      key.assign(1, (char)k);
+      key.append(scratch.text, start, end - start);
+      add(key.data(), key.size(), hashNGram(key.data(), key.size()));
+    }
   }
+}
+
+/// Like forEachNGram(), but for skip-grams: the words of a skip-gram
+/// are in order, but up to skip words in between may be left out.
+/// Contiguous ngrams are skip-grams too.
+template<class Add>
+void NGramCounter::forEachSkipGram(const char* line, size_t length, NGramScratch& scratch, Add add)
+{
+  if(vocabulary)
+    wordIds(line, length, scratch.words, scratch.ids);
+  else
+    paddedText(line, length, scratch.words, scratch.text, scratch.spans);
+  const size_t numWords = vocabulary ? scratch.ids.size() : scratch.spans.size();
 
-  if(!feof(chunkFiles[0]))
-    throw string("printOnlyChunk: read error");
+  string& key = scratch.key;
+  vector<uint32_t>& tuple = scratch.tuple;
+  for(int k=minN; k<=maxN; k++) {
+    const vector<size_t>& offsets = skipOffsets[k];
+    for(size_t i=maxN-k; i+k <= numWords; i++) {
+      for(size_t o=0; o<offsets.size(); o += k) {
+        if(i + offsets[o+k-1] >= numWords)
+          continue;
 
-  if(c_total != totalCount) {
-    cerr << "WARNING: input and output ngram counts mismatch: " << totalCount << " vs. " << c_total << endl;
+        if(vocabulary) {
+          tuple.clear();
+          for(int j=0; j<k; j++)
+            tuple.push_back(scratch.ids[i + offsets[o+j]]);
+          key.assign(1, (char)k);
+          key.append((const char*)&tuple[0], k*sizeof(uint32_t));
+          add(key.data(), key.size(), hashWordIds(&tuple[0], k));
+        } else {
+          key.assign(1, (char)k);
+          for(int j=0; j<k; j++) {
+            const WordSpan& span = scratch.spans[i + offsets[o+j]];
+            if(j > 0)
+              key.push_back(' ');
+            key.append(scratch.text, span.first, span.second);
+          }
+          add(key.data(), key.size(), hashNGram(key.data(), key.size()));
+        }
+      }
+    }
   }
-  
-  delete[] buf;
-  delete[] ngram;
-  fclose(chunkFiles[0]);
-  chunkFiles.clear();
 }
 
+/// Appends an ngram to the pending batch of its shard
+void NGramCounter::route(const char* key, size_t length, uint64_t hash,
+                         vector<PendingNGrams>& pending)
+{
+  PendingNGrams& batch = pending[shardOf(hash)];
+  batch.bytes.append(key, length);
+  batch.lengths.push_back(length);
+  batch.hashes.push_back(hash);
+}
 
-FILE* NGramCounter::mergeChunks(FILE* chunk1, FILE* chunk2, bool last)
+/// Adds pending ngrams to their shards, spilling shards which get
+/// full. Unless force is set, only large enough batches are added.
+void NGramCounter::flush(vector<PendingNGrams>& pending, bool force)
 {
-  FILE* mergedFile;
-  if(last) {
-    printf("%ld\n", totalCount);
-    mergedFile = stdout;
+  for(size_t s=0; s<shards.size(); s++) {
+    PendingNGrams& batch = pending[s];
+    if(batch.lengths.empty() || (!force && batch.bytes.size() < PENDING_SIZE))
+      continue;
+
+    NGramShard* shard = shards[s];
+    boost::lock_guard<boost::mutex> lock(shard->mutex);
+    checkMemory(shard, batch.bytes.size());
+    const char* key = batch.bytes.data();
+    for(size_t i=0; i<batch.lengths.size(); i++) {
+      shard->table.add(key, batch.lengths[i], batch.hashes[i], 1);
+      shard->totalCounts[(unsigned char)*key]++;
+      key += batch.lengths[i];
+    }
+
+    batch.bytes.clear();
+    batch.lengths.clear();
+    batch.hashes.clear();
+  }
+}
+
+/// Counts batches of lines until the queue is closed
+void NGramCounter::countWorker(LineBatchQueue* batches)
+{
+  NGramScratch scratch;
+  scratch.pending.resize(shards.size());
+  bool failed = false;
+
+  LineBatch* batch;
+  while((batch = batches->pop()) != NULL) {
+    // after an error keep draining the queue so that the reader
+    // doesn't block
+    try {
+      size_t start = 0;
+      for(size_t i=0; i<batch->ends.size() && !failed; i++) {
+        const char* line = batch->text.data() + start;
+        const size_t length = batch->ends[i] - start;
+        start = batch->ends[i];
+        if(isAllWhitespace(line, length))
+          continue;
+        forEachNGram(line, length, scratch, [this, &scratch](const char* key, size_t length, uint64_t hash) {
+            route(key, length, hash, scratch.pending);
+          });
+        flush(scratch.pending, false);
+      }
+    } catch(string err) {
+      boost::lock_guard<boost::mutex> lock(errorMutex);
+      workerError = err;
+      failed = true;
+    }
+    delete batch;
   }
+
+  try {
+    if(!failed)
+      flush(scratch.pending, true);
+  } catch(string err) {
+    boost::lock_guard<boost::mutex> lock(errorMutex);
+    workerError = err;
+  }
+}
+
+void NGramCounter::count(LineReader& in)
+{
+  if(closed)
+    throw string("NGramCounter is closed.");
+
+  // skip the input counted before the job was interrupted
+  const char* line;
+  size_t length;
+  while(inputOffset < resumeOffset && in.next(line, length))
+    inputOffset += length + 1;
+  if(inputOffset < resumeOffset)
+    throw string("Cannot resume: the input is shorter than the part counted already.");
+
+  if(shards.size() > 1)
+    countParallel(in);
   else
-    mergedFile = tmpfile();
+    countSerial(in);
+}
+
+void NGramCounter::countSerial(LineReader& in)
+{
+  const char* line;
+  size_t length;
+  while(in.next(line, length)) {
+    // a checkpoint taken while counting the line covers it
+    inputOffset += length + 1;
+    count(line, length);
+  }
+}
 
-  if(mergedFile == NULL)
-    throw string("Could not create output file to store merged chunks.");
+void NGramCounter::countParallel(LineReader& in)
+{
+  // with a work directory, the input is counted in segments of
+  // maxChunkSize bytes, each by its own set of workers. A checkpoint
+  // is taken in between, while no lines are being counted.
+  const long segmentSize = workDir.empty() ? LONG_MAX : maxChunkSize;
+  bool more = true;
+  while(more) {
+    LineBatchQueue batches(2*shards.size());
+    boost::thread_group workers;
+    for(size_t i=0; i<shards.size(); i++)
+      workers.create_thread([this, &batches]() { countWorker(&batches); });
 
-  mergeCounts(chunk1, chunk2, mergedFile);
+    const long segmentEnd = (inputOffset > LONG_MAX - segmentSize) ? LONG_MAX : inputOffset + segmentSize;
+    LineBatch* batch = new LineBatch();
+    const char* line;
+    size_t length;
+    while(inputOffset < segmentEnd && (more = in.next(line, length))) {
+      inputOffset += length + 1;
+      batch->text.append(line, length);
+      batch->ends.push_back(batch->text.size());
+      if(batch->text.size() >= BATCH_SIZE) {
+        batches.push(batch);
+        batch = new LineBatch();
+      }
+    }
+    batches.push(batch);
+    batches.close();
+    workers.join_all();
 
-  // mergedFile is yet another chunk that we'll have to merge. Hence we'll rewind it
-  // so that future reads start from the beginning.
-  if(!last) 
-    rewind(mergedFile);
-  
-  fclose(chunk1);
-  fclose(chunk2);
-  return last ? NULL : mergedFile;
+    if(!workerError.empty())
+      throw workerError;
+    if(more)
+      checkpoint();
+  }
 }
 
-void NGramCounter::mergeAll()
+/// Returns the start of the first line at or after offset, or size
+/// if there's none
+off_t lineStart(int fd, off_t offset, off_t size)
 {
-  if(chunkFiles.size() == 1) {
-    printOnlyChunk();
-    return;
-  }  
+  if(offset <= 0 || offset >= size)
+    return min(max(offset, (off_t)0), size);
 
-  // pairwise merge until two chunks remain
-  while(chunkFiles.size() > 2) {
-    if(verbose)
-      cerr << "Merge one level. Start no. chunks: " << chunkFiles.size() << endl;
+  // a line starts at offset if the previous byte ends a line
+  char buffer[64*1024];
+  off_t pos = offset - 1;
+  while(pos < size) {
+    ssize_t cRead = pread(fd, buffer, sizeof(buffer), pos);
+    if(cRead < 0 && errno == EINTR)
+      continue;
+    if(cRead <= 0)
+      throw string("Read error: ") + strerror(cRead < 0 ? errno : EIO);
+    const char* newline = (const char*)memchr(buffer, '\n', cRead);
+    if(newline != NULL)
+      return min(pos + (newline - buffer) + 1, size);
+    pos += cRead;
+  }
+  return size;
+}
+
+void NGramCounter::countFile(const string& path)
+{
+  if(closed)
+    throw string("NGramCounter is closed.");
+
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if(fd < 0 || fstat(fd, &info) != 0)
+    throw string("Could not open ") + path + ": " + strerror(errno);
+  const off_t size = info.st_size;
 
-    vector<FILE*> newChunks;
-    newChunks.reserve(chunkFiles.size());
-    for(size_t i=0; i<chunkFiles.size()-1; i += 2) {
-      FILE* chunk1 = chunkFiles[i];
-      FILE* chunk2 = chunkFiles[i+1];
-      newChunks.push_back(mergeChunks(chunk1, chunk2, false));    
+  try {
+    // offsets of a resumed job always fall on line boundaries
+    if(resumeOffset > size)
+      throw string("Cannot resume: the input is shorter than the part counted already.");
+    inputOffset = resumeOffset;
+    if(shards.size() == 1) {
+      LineReader in(fd, min((off_t)inputOffset, size), max(size - inputOffset, (off_t)0));
+      countSerial(in);
     }
 
-    if(chunkFiles.size() % 2 == 1) // odd number of chunks
-      newChunks.push_back(chunkFiles[chunkFiles.size()-1]);
+    // the file is counted in segments like in countParallel(), each
+    // one split evenly between the threads
+    const off_t segmentSize = workDir.empty() ? size : maxChunkSize;
+    while(shards.size() > 1 && inputOffset < size) {
+      const off_t segmentEnd = lineStart(fd, inputOffset + segmentSize, size);
+      vector<off_t> ends(1, inputOffset);
+      for(size_t i=1; i<=shards.size(); i++) {
+        const off_t end = lineStart(fd, inputOffset + (segmentEnd - inputOffset)*i/shards.size(), segmentEnd);
+        ends.push_back(max(end, ends.back()));
+      }
+
+      boost::thread_group workers;
+      for(size_t i=0; i<shards.size(); i++) {
+        const off_t start = ends[i], end = ends[i+1];
+        workers.create_thread([this, fd, start, end]() { countSplit(fd, start, end); });
+      }
+      workers.join_all();
 
-    chunkFiles = newChunks;
+      if(!workerError.empty())
+        throw workerError;
+      inputOffset = segmentEnd;
+      if(inputOffset < size)
+        checkpoint();
+    }
+  } catch(string err) {
+    ::close(fd);
+    throw;
   }
+  ::close(fd);
+}
 
-  // At this point we only have two chunks: just print them out,
-  // no reason to save them to a file first since we're done.
-  mergeChunks(chunkFiles[0], chunkFiles[1], true);
-  chunkFiles.clear();
+/// Counts the lines of bytes start to end of a file, routing ngrams
+/// to shards like countWorker()
+void NGramCounter::countSplit(int fd, off_t start, off_t end)
+{
+  NGramScratch scratch;
+  scratch.pending.resize(shards.size());
+  try {
+    LineReader in(fd, start, end - start);
+    const char* line;
+    size_t length;
+    while(in.next(line, length)) {
+      if(isAllWhitespace(line, length))
+        continue;
+      forEachNGram(line, length, scratch, [this, &scratch](const char* key, size_t length, uint64_t hash) {
+          route(key, length, hash, scratch.pending);
+        });
+      flush(scratch.pending, false);
+    }
+    flush(scratch.pending, true);
+  } catch(string err) {
+    boost::lock_guard<boost::mutex> lock(errorMutex);
+    workerError = err;
+  }
 }
 
+/// Writes out the final counts: the in-memory tables of all shards
+/// are merged with their chunks in a single pass, without spilling
+/// the tables first.
 void NGramCounter::close()
 {
-  endChunk();
-  mergeAll();
+  if(!summaries.empty()) {
+    closeApproximate();
+    return;
+  }
+
+  vector<long> totalCounts(maxN+1, 0);
+  vector<FILE*> chunks;
+  vector<CountReader*> readers;
+  for(size_t s=0; s<shards.size(); s++) {
+    NGramShard* shard = shards[s];
+    waitForSpill(shard);
+    if(vocabulary)
+      readers.push_back(new InternedTableReader(&shard->table, vocabulary));
+    else {
+      shard->table.sort();
+      readers.push_back(new TableCountReader(&shard->table));
+    }
+    chunks.insert(chunks.end(), shard->chunkFiles.begin(), shard->chunkFiles.end());
+    shard->obsolete.insert(shard->obsolete.end(), shard->chunkNames.begin(), shard->chunkNames.end());
+    shard->chunkFiles.clear();
+    shard->chunkLevels.clear();
+    shard->chunkNames.clear();
+    for(int k=minN; k<=maxN; k++)
+      totalCounts[k] += shard->totalCounts[k];
+  }
+
+  for(size_t i=0; i<chunks.size(); i++)
+    readers.push_back(new ChunkReader(chunks[i]));
+
+  if(verbose)
+    cerr << "Merging " << chunks.size() << " chunks." << endl;
+
+  long totalCount = 0;
+  for(int k=minN; k<=maxN; k++)
+    totalCount += totalCounts[k];
+
+  // counts are only complete in this last merge, so this is where
+  // the threshold applies. The totals of partitions, and of counts
+  // above a threshold, are only known once everything is merged, so
+  // those outputs are merged twice: once for their totals, and once
+  // for their counts. Indexed outputs keep their totals at the end.
+  if(!indexed && (partitions > 1 || threshold > 1)) {
+    OrderCountWriter totals(vector<FILE*>(outputs.size(), NULL), partitions, 0, false);
+    mergeCounts(readers, totals, threshold);
+    for(size_t i=0; i<readers.size(); i++)
+      readers[i]->rewind();
+    for(size_t i=minN*partitions; i<outputs.size(); i++)
+      fprintf(outputs[i], "%ld\n", totals.totals[i]);
+  } else if(!indexed) {
+    for(int k=minN; k<=maxN; k++)
+      fprintf(outputs[k], "%ld\n", totalCounts[k]);
+  }
+  OrderCountWriter writer(outputs, partitions, top, indexed);
+  long c_kept;
+  long c_total = mergeCounts(readers, writer, threshold, &c_kept);
+
+  for(size_t i=0; i<readers.size(); i++)
+    delete readers[i];
+  for(size_t i=0; i<chunks.size(); i++)
+    fclose(chunks[i]);
+  for(size_t s=0; s<shards.size(); s++)
+    shards[s]->table.clear();
+  for(int k=minN; k<=maxN; k++) {
+    for(size_t p=0; p<partitions; p++)
+      closeOutput(k, p);
+  }
+
+  // the job is done, so its checkpoint goes too
+  if(!workDir.empty()) {
+    unlink((workDir + "/manifest").c_str());
+    removeObsolete();
+  }
+
+  if(c_total != totalCount) {
+    cerr << "WARNING: input and output ngram counts mismatch: " << totalCount << " vs. " << c_total << endl;
+  }
   closed = true;
+
+  if(verbose && threshold > 1)
+    cerr << "Kept " << c_kept << " of " << c_total << " ngrams counted at least "
+         << threshold << " times." << endl;
+
+  if(verbose)
+    reportMemory();
 }
 
-vector<string>* NGramCounter::ngrams(const string line, vector<string>* ngrams)
+/// Closes the output of order k and partition p, or flushes it if
+/// it's stdout, and throws if any write to it failed
+void NGramCounter::closeOutput(int k, size_t p)
 {
-  vector<string> words;
-  string word = "";
-
-  // add "start" words
-  for(int i=0; i < n-1; i++) {
-    words.push_back("<s>");
-  }
+  FILE* output = outputs[k*partitions + p];
+  outputs[k*partitions + p] = NULL;
+  if(output == stdout) {
+    if(fflush(stdout) != 0 || ferror(stdout))
+      throw string("Could not write the counts to standard output.");
+  } else if(fclose(output) != 0)
+    throw string("Could not write ") + outputPath(k, p);
+}
 
-  for(size_t i=0; i<line.size(); i++) {
-    char ch = line[i];
-    if(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
-      if(word.size() > 0)
-        words.push_back(word);
+/// Writes out the approximate counts of each order, sorted by ngram
+/// like exact counts. The third column is the maximum error of each
+/// count.
+void NGramCounter::closeApproximate()
+{
+  for(int k=minN; k<=maxN; k++) {
+    const SpaceSaving& summary = *summaries[k];
+    vector<pair<string, size_t> > ngrams(summary.size());
+    for(size_t i=0; i<summary.size(); i++) {
+      const string& key = summary[i].key;
+      if(vocabulary)
+        vocabulary->join(key.data()+1, k, ngrams[i].first);
+      else
+        ngrams[i].first.assign(key, 1, string::npos);
+      ngrams[i].second = i;
+    }
+    sort(ngrams.begin(), ngrams.end());
 
-      word = "";
+    LineWriter out(outputs[k]);
+    out.write(shards[0]->totalCounts[k]);
+    out.put('\n');
+    for(size_t i=0; i<ngrams.size(); i++) {
+      const SpaceSaving::Counter& counter = summary[ngrams[i].second];
+      out.write(counter.count);
+      out.put('\t');
+      out.write(ngrams[i].first);
+      out.put('\t');
+      out.write(counter.error);
+      out.put('\n');
     }
-    else
-      word += ch;
+    out.flush();
+
+    closeOutput(k, 0);
   }
+  closed = true;
 
-  if(word.size() > 0)
-    words.push_back(word);
+  if(verbose)
+    reportMemory();
+}
+
+/// Prints the memory limit next to the memory actually used. Tables
+/// never shrink, so what they hold now is their peak.
+void NGramCounter::reportMemory()
+{
+  const double MB = 1024.0*1024.0;
+  size_t tableBytes = 0;
+  for(size_t s=0; s<shards.size(); s++)
+    tableBytes += shards[s]->table.peak() + shards[s]->spare.peak();
+  for(size_t k=0; k<summaries.size(); k++)
+    tableBytes += summaries[k] ? summaries[k]->bytes() : 0;
+  size_t vocabularyBytes = vocabulary ? vocabulary->bytes() : 0;
 
-  words.push_back("</s>"); // the "end" word
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
 
-  // build ngrams based on tokenized line
-  ngrams->clear();
-  for(size_t i=n-1; i<words.size(); i++) {
-    string ngram = "";
-    for(size_t j=i-n+1; j <= i; j++) {
-      if(ngram.size() > 0)
-        ngram += " ";
-      ngram += words[j];
+  cerr << "Memory limit: " << maxChunkSize/MB << " MB. Peak usage: "
+       << (tableBytes + vocabularyBytes)/MB << " MB (tables: " << tableBytes/MB
+       << " MB, vocabulary: " << vocabularyBytes/MB << " MB). Peak RSS: "
+       << usage.ru_maxrss/1024.0 << " MB." << endl;
+}
+
+/// Splits a line into words, as (start, length) ranges of the line
+void splitWords(const char* line, size_t length, vector<WordSpan>& words)
+{
+  words.clear();
+  size_t start = 0;
+  for(size_t i=0; i<=length; i++) {
+    char ch = (i < length) ? line[i] : ' ';
+    if(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+      if(i > start)
+        words.push_back(WordSpan(start, i - start));
+      start = i+1;
     }
-    ngrams->push_back(ngram);
   }
-  return ngrams;
+}
+
+void NGramCounter::paddedText(const char* line, size_t length, vector<WordSpan>& words,
+                              string& text, vector<WordSpan>& spans)
+{
+  splitWords(line, length, words);
+  text.clear();
+  spans.clear();
+  for(int i=0; i < maxN-1; i++) {
+    spans.push_back(WordSpan(text.size(), 3));
+    text.append("<s> ");
+  }
+  for(size_t i=0; i<words.size(); i++) {
+    spans.push_back(WordSpan(text.size(), words[i].second));
+    text.append(line + words[i].first, words[i].second);
+    text.push_back(' ');
+  }
+  spans.push_back(WordSpan(text.size(), 4));
+  text.append("</s>");
+}
+
+void NGramCounter::wordIds(const char* line, size_t length, vector<WordSpan>& words,
+                           vector<uint32_t>& ids)
+{
+  splitWords(line, length, words);
+  ids.assign(maxN-1, START_WORD_ID);
+  vocabulary->lookup(line, words, ids);
+  ids.push_back(END_WORD_ID);
 }
 
 void printUsage(const char* name)
 {
-  printf("Usage: %s [-n NUMBER] [-m LIMIT] [-v]\n", name);
+  printf("Usage: %s [-n NUMBER|MIN-MAX] [--skip K] [-o PREFIX] [-m LIMIT] [-f FANIN] [-j THREADS] [-i] [-z] [-t THRESHOLD] [--top K] [--indexed] [-a COUNTERS] [--partitions K [--partition-by hash]] [--work-dir DIR [--resume]] [-v] [FILE]\n", name);
 }
 
 int main(int argc, const char** argv)
 {
   size_t chunkSize = 500*1024*1024;
-  int n = 2;
+  const char* orders = "2";
+  long minN = 2, maxN = 2;
+  int skip = 0;
+  string outputPrefix;
+  int fanIn = 128;
+  int threads = 1;
+  bool intern = false;
+  bool compress = false;
+  long approximate = 0;
+  long partitions = 1;
+  long threshold = 0;
+  long top = 0;
+  bool indexed = false;
+  string workDir;
+  bool resume = false;
   bool verbose = false;
+  string inputPath;
   for(int i=1; i<argc; i++) {
     if(strcmp("-m", argv[i]) == 0 && i<argc-1) {
-      long size = 100*1024*1024;
-      long multiplier = 1;
-      char unit = '\0';
-      sscanf(argv[i+1], "%ld%c", &size, &unit);
-      unit = tolower(unit);
-
-      switch(unit) {
-      case 'b':
-        multiplier = 512;
-        break;
-      case 'k':
-        multiplier = 1024;
-        break;
-      case 'm':
-        multiplier = 1024*1024;
-        break;
-      case 'g':
-        multiplier = 1024*1024*1024;
-        break;
-      case'\0':
-        multiplier = 1;
-        break;
-      default:
+      if(!parseSize(argv[i+1], chunkSize)) {
         printUsage(argv[0]);
         return 1;
       }
-      
-      chunkSize = size*multiplier;
       i++;
     }
     else if(strcmp("-n", argv[i]) == 0 && i<argc-1) {
-      n = atoi(argv[i+1]);
+      // either a single order, or a range of orders counted in one pass
+      orders = argv[i+1];
+      if(!parseRange(argv[i+1], minN, maxN))
+        minN = maxN = 0; // rejected below
+      i++;
+    }
+    else if(strcmp("--skip", argv[i]) == 0 && i<argc-1) {
+      skip = atoi(argv[i+1]);
+      if(skip < 0) {
+        cerr << "Invalid skip: " << argv[i+1] << endl;
+        return 1;
+      }
+      i++;
+    }
+    else if(strcmp("-o", argv[i]) == 0 && i<argc-1) {
+      outputPrefix = argv[i+1];
+      i++;
+    }
+    else if(strcmp("-f", argv[i]) == 0 && i<argc-1) {
+      fanIn = atoi(argv[i+1]);
       i++;
     }
+    else if(strcmp("-j", argv[i]) == 0 && i<argc-1) {
+      threads = atoi(argv[i+1]);
+      i++;
+    }
+    else if(strcmp("-i", argv[i]) == 0) {
+      intern = true;
+    }
+    else if(strcmp("-z", argv[i]) == 0) {
+      compress = true;
+    }
+    else if(strcmp("-a", argv[i]) == 0 && i<argc-1) {
+      approximate = atol(argv[i+1]);
+      i++;
+    }
+    else if(strcmp("-t", argv[i]) == 0 && i<argc-1) {
+      threshold = atol(argv[i+1]);
+      i++;
+    }
+    else if(strcmp("--top", argv[i]) == 0 && i<argc-1) {
+      top = atol(argv[i+1]);
+      if(top <= 0) {
+        cerr << "Invalid number of top ngrams: " << argv[i+1] << endl;
+        return 1;
+      }
+      i++;
+    }
+    else if(strcmp("--indexed", argv[i]) == 0) {
+      indexed = true;
+    }
+    else if(strcmp("--partitions", argv[i]) == 0 && i<argc-1) {
+      partitions = atol(argv[i+1]);
+      i++;
+    }
+    else if(strcmp("--partition-by", argv[i]) == 0 && i<argc-1) {
+      // hashing is the only way to partition so far
+      if(strcmp("hash", argv[i+1]) != 0) {
+        cerr << "Unknown partitioning: " << argv[i+1] << endl;
+        return 1;
+      }
+      i++;
+    }
+    else if(strcmp("--work-dir", argv[i]) == 0 && i<argc-1) {
+      workDir = argv[i+1];
+      i++;
+    }
+    else if(strcmp("--resume", argv[i]) == 0) {
+      resume = true;
+    }
     else if(strcmp("-v", argv[i]) == 0) {
       verbose = true;
     }
+    else if(argv[i][0] != '-' && inputPath.empty()) {
+      inputPath = argv[i];
+    }
     else {
       printUsage(argv[0]);
       return 1;
@@ -325,17 +1406,95 @@ int main(int argc, const char** argv)
     cerr << "WARNING: Very small selected chunk size. Performance might suffer." << endl;
   }
 
-  if(n <= 0) {
-    cerr << "Invalid ngram size: " << n << endl;
+  if(minN <= 0 || maxN < minN || maxN > 255) {
+    cerr << "Invalid ngram size: " << orders << endl;
+    return 1;
+  }
+
+  if(maxN > minN && outputPrefix.empty()) {
+    cerr << "A range of ngram sizes requires an output prefix (-o)." << endl;
+    return 1;
+  }
+
+  if(fanIn < 2) {
+    cerr << "Invalid merge fan-in: " << fanIn << endl;
+    return 1;
+  }
+
+  if(threads <= 0) {
+    cerr << "Invalid number of threads: " << threads << endl;
+    return 1;
+  }
+
+  // every thread counts into two tables, which can't be made smaller
+  // than an empty one
+  const size_t minChunkSize = 2*threads*NGramTable::minBytes();
+  if(approximate == 0 && threads > 1 && chunkSize < minChunkSize) {
+    cerr << "Memory limit (-m) too small for " << threads << " threads: needs at least "
+         << (minChunkSize + 1024*1024 - 1)/(1024*1024) << "M." << endl;
+    return 1;
+  }
+  if(approximate == 0 && chunkSize < minChunkSize) {
+    cerr << "WARNING: Memory limit below " << (minChunkSize + 1024*1024 - 1)/(1024*1024)
+         << "M. The ngram tables will use that much." << endl;
+  }
+
+  // approximate counting keeps everything in memory, so options
+  // concerning chunks don't apply
+  if(partitions <= 0) {
+    cerr << "Invalid number of partitions: " << partitions << endl;
+    return 1;
+  }
+
+  if(partitions > 1 && outputPrefix.empty()) {
+    cerr << "Partitioned output (--partitions) requires an output prefix (-o)." << endl;
+    return 1;
+  }
+
+  if(approximate < 0 || (approximate > 0 && (threads > 1 || compress || threshold > 1 || top > 0
+                                              || partitions > 1 || !workDir.empty()))) {
+    cerr << "Approximate counting (-a) requires a positive number of counters "
+         << "and cannot be combined with -j, -z, -t, --top, --partitions or --work-dir." << endl;
     return 1;
   }
 
-  NGramCounter counter(n, chunkSize, verbose);
+  // indexed outputs are sorted by ngram, and have two columns
+  if(indexed && (top > 0 || approximate > 0)) {
+    cerr << "Indexed output (--indexed) cannot be combined with --top or -a." << endl;
+    return 1;
+  }
+
+  if(resume && workDir.empty()) {
+    cerr << "Resuming (--resume) requires a work directory (--work-dir)." << endl;
+    return 1;
+  }
 
-  string line;
+  NGramOptions options;
+  options.minN = minN;
+  options.maxN = maxN;
+  options.skip = skip;
+  options.outputPrefix = outputPrefix;
+  options.maxChunkSize = chunkSize;
+  options.fanIn = fanIn;
+  options.threads = threads;
+  options.intern = intern;
+  options.compress = compress;
+  options.approximate = approximate;
+  options.partitions = partitions;
+  options.threshold = threshold;
+  options.top = top;
+  options.indexed = indexed;
+  options.workDir = workDir;
+  options.resume = resume;
+  options.inputPath = inputPath;
+  options.verbose = verbose;
   try {
-    while(getline(cin, line)) {
-      counter.count(line);
+    NGramCounter counter(options);
+    if(inputPath.empty()) {
+      LineReader input(0);
+      counter.count(input);
+    } else {
+      counter.countFile(inputPath);
     }
     counter.close();
   } catch(string err) {
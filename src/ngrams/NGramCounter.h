@@ -28,39 +28,178 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <set>
+#include <boost/thread.hpp>
+#include "NGramTable.h"
+#include "Vocabulary.h"
+#include "SpaceSaving.h"
+#include "LineIO.h"
+
+class LineBatchQueue;
+
+/** Options controlling how NGramCounter counts */
+struct NGramOptions
+{
+  int minN; // desired numbers of words in an ngram, from minN to maxN
+  int maxN;
+  int skip; // words that may be skipped within an ngram, for skip-grams
+  std::string outputPrefix; // counts of order n go to outputPrefix.n, or stdout if empty
+  size_t maxChunkSize; // in bytes, of all tables and the vocabulary together
+  size_t fanIn; // maximum number of chunks merged (and open) at once
+  int threads;
+  bool intern; // count ngrams as tuples of word IDs
+  bool compress; // compress chunk files
+  size_t approximate; // counters per order when counting approximately, or 0
+  size_t partitions; // hash partitions of the output of each order
+  long threshold; // only output ngrams counted at least this many times
+  size_t top; // only output this many most frequent ngrams of each order, or 0 for all
+  bool indexed; // write the outputs in the indexed format (see IndexedFile.cpp)
+  std::string workDir; // keep chunks and a manifest here, or use temporary files if empty
+  bool resume; // continue the job checkpointed in workDir
+  std::string inputPath; // of the file to be counted, or empty for stdin
+  bool verbose;
+
+  NGramOptions() : minN(2), maxN(2), skip(0), maxChunkSize(500*1024*1024), fanIn(128), threads(1),
+                   intern(false), compress(false), approximate(0), partitions(1), threshold(0),
+                   top(0), indexed(false), resume(false), verbose(false) { }
+};
+
+/** A hash partition of the ngrams being counted. Each shard has its
+    own table and spills its own chunks. A full table is swapped with
+    the spare one and spilled by a background thread, while counting
+    continues in the other. */
+struct NGramShard
+{
+  NGramTable table;
+  NGramTable spare; // being spilled while spiller runs
+  boost::thread spiller;
+  std::string spillError;
+  std::vector<FILE*> chunkFiles; // store chunk filenames. Only the spiller touches them while it runs.
+  std::vector<int> chunkLevels; // how many merges produced each chunk
+  std::vector<std::string> chunkNames; // within the work directory, empty for temporary files
+  std::vector<std::string> obsolete; // merged chunks, removed after the next checkpoint
+  std::vector<long> totalCounts; // by order
+  boost::mutex mutex;
+
+  NGramShard(int maxN) : totalCounts(maxN+1, 0) { }
+};
+
+/** Ngrams of one counting thread waiting to be added to a shard. They
+    are added in batches so that shard locks are taken rarely. Like
+    all keys counted by NGramCounter, each ngram starts with a byte
+    holding its order. */
+struct PendingNGrams
+{
+  std::string bytes;
+  std::vector<size_t> lengths;
+  std::vector<uint64_t> hashes;
+};
+
+/** Per-thread buffers for splitting lines into ngrams */
+struct NGramScratch
+{
+  std::vector<WordSpan> words; // within the line
+  std::string text;            // the padded line
+  std::vector<WordSpan> spans; // words within text
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> tuple; // IDs of a skip-gram
+  std::string key;
+  std::vector<PendingNGrams> pending;
+};
 
 /** Iteratively counts n-grams in input, line by line. */
 class NGramCounter
 {
  private:
-  std::unordered_map<std::string, long> currentCounts;
-  std::set<std::string> sortedNGrams;
-  std::vector<std::string> lineNGrams;
-  int n; // desired number of words in an ngram
+  std::vector<NGramShard*> shards;
+  Vocabulary* vocabulary; // NULL unless ngrams are interned
+  std::vector<SpaceSaving*> summaries; // by order, only when counting approximately
+  NGramScratch scratch;
+  int minN; // desired numbers of words in an ngram
+  int maxN;
+  int skip; // words that may be skipped within an ngram
+  std::vector<std::vector<size_t> > skipOffsets; // by order: word offsets of each skip-gram, k at a time
+  std::string outputPrefix;
+  size_t partitions; // of the output of each order
+  std::vector<FILE*> outputs; // by order and partition: outputs[k*partitions + p]
+  long threshold;
+  size_t top;
+  bool indexed;
   bool closed;  
   bool verbose;
-  long totalCount;
-  size_t maxChunkSize; // in bytes, including auxiliary data structures
-  size_t maxChunkLength; // in characters, w/o auxiliary data structures
-  size_t chunkLength;
-
-  std::vector<FILE*> chunkFiles; // store chunk filenames
-  void endChunk();
-  FILE* mergeChunks(FILE*, FILE*, bool);
-  void mergeAll();
-  void printOnlyChunk();
-
-  /** Returns ngrams in a single line of input (may return
-      duplicates if they exist) */
-  std::vector<std::string>* ngrams(std::string line, std::vector<std::string>*);
+  bool compress;
+  size_t maxChunkSize; // in bytes, of all tables and the vocabulary together
+  size_t fanIn; // maximum number of chunks merged (and open) at once, per shard
+  std::string workerError;
+  boost::mutex errorMutex;
+  std::string workDir;
+  size_t nextChunk; // number of the next chunk file in workDir
+  boost::mutex chunkMutex;
+  long inputOffset; // bytes of input read so far
+  long resumeOffset; // bytes of input counted before resuming
+  long checkpointOffset; // input covered by the chunk being spilled
+  std::string input; // canonical path of the input file, or "-" for stdin
+  long long inputSize; // of the input file
+  long long inputTime; // modification time of the input file
+  std::vector<long> checkpointTotals;
+
+  size_t shardOf(uint64_t hash);
+  void route(const char*, size_t, uint64_t, std::vector<PendingNGrams>&);
+  void flush(std::vector<PendingNGrams>&, bool);
+  size_t tableBudget();
+  void checkMemory(NGramShard*, size_t length);
+  void endChunk(NGramShard*, bool checkpoint);
+  void spill(NGramShard*, bool checkpoint);
+  void waitForSpill(NGramShard*);
+  FILE* newChunk(std::string& name);
+  void syncChunk(FILE*);
+  void checkpoint();
+  void writeManifest(long offset, const std::vector<long>& totals);
+  void removeObsolete();
+  size_t removeUnlisted(const std::vector<std::string>& chunks);
+  void resume();
+  void compactChunks(NGramShard*);
+  void countWorker(LineBatchQueue*);
+  long writeTable(NGramTable&, FILE*);
+  std::string outputPath(int k, size_t p);
+  void closeOutput(int k, size_t p);
+  void reportMemory();
+  void closeApproximate();
+  template<class Add> void forEachNGram(const char*, size_t, NGramScratch&, Add);
+  template<class Add> void forEachSkipGram(const char*, size_t, NGramScratch&, Add);
+
+  /** Splits a line into words, which are copied to text separated
+      by single spaces and padded with enough <s> for the highest
+      order, and </s>. Every ngram is then a range of text. */
+  void paddedText(const char* line, size_t length, std::vector<WordSpan>& words,
+                  std::string& text, std::vector<WordSpan>& spans);
+
+  /** Splits a line into words and looks up their IDs, padded with
+      the IDs of <s> and </s> like paddedText() pads words */
+  void wordIds(const char* line, size_t length, std::vector<WordSpan>&,
+               std::vector<uint32_t>&);
   
  public:
-  NGramCounter(const int, const size_t, const bool);
+  NGramCounter(const NGramOptions&);
   ~NGramCounter();
-  void count(std::string line);  
+  void count(const char* line, size_t length);
+  void count(const std::string& line) { count(line.data(), line.size()); }
+
+  /** Counts all lines in the input. With several shards, lines are
+      counted by one thread per shard, while the calling thread reads
+      the input. Input counted before a resumed job was interrupted
+      is skipped, and checkpoints are only taken here. */
+  void count(LineReader& in);
+
+  /** Counts all lines of a file. Unlike count(LineReader&), each
+      thread reads its own line-aligned split of the file, and input
+      counted before a resumed job was interrupted is seeked past. */
+  void countFile(const std::string& path);
   void close();
+
+ private:
+  void countSerial(LineReader& in);
+  void countParallel(LineReader& in);
+  void countSplit(int fd, off_t start, off_t end);
 };
 
 #endif // NGramCounter_h
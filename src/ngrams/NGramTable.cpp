@@ -0,0 +1,220 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    NGramTable.cpp: implements the table NGramCounter uses to count
+                    ngrams within a single chunk. Each distinct ngram
+                    is copied once into a bump arena, and an open-addressing
+                    hash table of (hash, offset, count) entries indexes
+                    the arena. Nothing is kept in sorted order while
+                    counting: entries are sorted only once, when the chunk
+                    is written out.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <string>
+#include "NGramTable.h"
+
+using namespace std;
+
+const size_t ARENA_BLOCK_SIZE = 1024*1024;
+const size_t INITIAL_CAPACITY = 1 << 16;
+
+size_t NGramTable::minBytes()
+{
+  return INITIAL_CAPACITY*sizeof(Entry) + ARENA_BLOCK_SIZE;
+}
+
+NGramTable::NGramTable() {
+  this->slots.resize(INITIAL_CAPACITY);
+  this->mask = INITIAL_CAPACITY - 1;
+  this->used = 0;
+  this->sorted = false;
+  this->maxBytes = (size_t)-1;
+  this->full = false;
+  this->block = 0;
+  this->blockPos = 0;
+  this->arenaBytes = 0;
+  this->arenaUsed = 0;
+  this->peakBytes = bytes();
+}
+
+NGramTable::~NGramTable()
+{
+  for(size_t i=0; i<blocks.size(); i++)
+    delete[] blocks[i];
+}
+
+/// Copies an ngram into the arena and returns its offset
+uint64_t NGramTable::store(const char* key, size_t length)
+{
+  // move on to the next block if the current one is full. Blocks
+  // left over from previous chunks are reused.
+  while(block < blocks.size() && blockPos + length > blockSizes[block]) {
+    arenaUsed += blockSizes[block] - blockPos;
+    block++;
+    blockPos = 0;
+  }
+
+  if(block == blocks.size()) {
+    size_t size = max(ARENA_BLOCK_SIZE, length);
+    blocks.push_back(new char[size]);
+    blockSizes.push_back(size);
+    arenaBytes += size;
+    peakBytes = max(peakBytes, bytes());
+  }
+
+  memcpy(blocks[block] + blockPos, key, length);
+  uint64_t offset = ((uint64_t)block << 32) | blockPos;
+  blockPos += length;
+  arenaUsed += length;
+  return offset;
+}
+
+bool NGramTable::fits(size_t length) const
+{
+  // room left in the blocks already allocated, and in whole blocks
+  // which may still be allocated. Moving on to a new block wastes the
+  // end of the previous one, at most one key per block.
+  const size_t slotBytes = slots.size()*sizeof(Entry);
+  size_t room = arenaBytes - arenaUsed;
+  if(slotBytes + arenaBytes < maxBytes)
+    room += (maxBytes - slotBytes - arenaBytes) / ARENA_BLOCK_SIZE * ARENA_BLOCK_SIZE;
+  return 2*length <= room;
+}
+
+/// Doubles the number of slots and reinserts all entries
+void NGramTable::grow()
+{
+  vector<Entry> old(slots.size()*2);
+  old.swap(slots);
+  mask = slots.size() - 1;
+
+  for(size_t i=0; i<old.size(); i++) {
+    if(old[i].count == 0)
+      continue;
+
+    size_t pos = old[i].hash & mask;
+    while(slots[pos].count != 0)
+      pos = (pos + 1) & mask;
+    slots[pos] = old[i];
+  }
+  peakBytes = max(peakBytes, bytes());
+}
+
+void NGramTable::add(const char* key, size_t length, uint64_t fullHash, long count)
+{
+  if(sorted)
+    throw string("NGramTable: cannot add to a sorted table.");
+
+  const uint32_t hash = (uint32_t)(fullHash ^ (fullHash >> 32));
+
+  size_t pos = hash & mask;
+  while(slots[pos].count != 0) {
+    Entry& entry = slots[pos];
+    if(entry.hash == hash && entry.length == length
+       && memcmp(this->key(entry), key, length) == 0) {
+      entry.count += count;
+      return;
+    }
+    pos = (pos + 1) & mask;
+  }
+
+  Entry& entry = slots[pos];
+  entry.hash = hash;
+  entry.length = length;
+  entry.offset = store(key, length);
+  entry.count = count;
+  used++;
+
+  // keep the load factor under 0.7 so that probe sequences stay short,
+  // unless growing would exceed maxBytes. Growing briefly holds both
+  // the old and the new slots. A full table still grows before probe
+  // sequences get very long.
+  if(used*10 >= slots.size()*7) {
+    if(3*slots.size()*sizeof(Entry) + arenaBytes <= maxBytes || used*20 >= slots.size()*19)
+      grow();
+    else
+      full = true;
+  }
+}
+
+void NGramTable::sort()
+{
+  // compact the occupied slots to the front, then sort them in place
+  size_t j = 0;
+  for(size_t i=0; i<slots.size(); i++) {
+    if(slots[i].count != 0)
+      slots[j++] = slots[i];
+  }
+
+  std::sort(slots.begin(), slots.begin() + used,
+            [this](const Entry& a, const Entry& b) {
+              int cmp = memcmp(key(a), key(b), min(a.length, b.length));
+              return cmp < 0 || (cmp == 0 && a.length < b.length);
+            });
+  sorted = true;
+}
+
+void NGramTable::clear()
+{
+  // give back what maxBytes no longer allows, e.g. after it was
+  // lowered to make room for a growing vocabulary
+  while(blocks.size() > 1 && slots.size()*sizeof(Entry) + arenaBytes > maxBytes) {
+    arenaBytes -= blockSizes.back();
+    delete[] blocks.back();
+    blocks.pop_back();
+    blockSizes.pop_back();
+  }
+  if(slots.size() > INITIAL_CAPACITY && slots.size()*sizeof(Entry) + arenaBytes > maxBytes) {
+    size_t capacity = slots.size();
+    while(capacity > INITIAL_CAPACITY && capacity*sizeof(Entry) + arenaBytes > maxBytes)
+      capacity /= 2;
+    vector<Entry>(capacity).swap(slots);
+    mask = capacity - 1;
+  }
+
+  for(size_t i=0; i<slots.size(); i++)
+    slots[i].count = 0;
+
+  used = 0;
+  sorted = false;
+  full = false;
+  block = 0;
+  blockPos = 0;
+  arenaUsed = 0;
+}
+
+void NGramTable::swap(NGramTable& other)
+{
+  slots.swap(other.slots);
+  std::swap(mask, other.mask);
+  std::swap(used, other.used);
+  std::swap(sorted, other.sorted);
+  std::swap(maxBytes, other.maxBytes);
+  std::swap(full, other.full);
+  blocks.swap(other.blocks);
+  blockSizes.swap(other.blockSizes);
+  std::swap(block, other.block);
+  std::swap(blockPos, other.blockPos);
+  std::swap(arenaBytes, other.arenaBytes);
+  std::swap(arenaUsed, other.arenaUsed);
+  std::swap(peakBytes, other.peakBytes);
+}
@@ -0,0 +1,182 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    NGramTable.h: see NGramTable.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef NGramTable_h
+#define NGramTable_h
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "CountStream.h"
+
+/** Hashes ngram bytes, 8 bytes at a time. */
+inline uint64_t hashNGram(const char* key, size_t length)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ length;
+  size_t i = 0;
+  for(; i+8 <= length; i += 8) {
+    uint64_t w;
+    memcpy(&w, key+i, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+
+  uint64_t w = 0;
+  memcpy(&w, key+i, length-i);
+  h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 29;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 32;
+  return h;
+}
+
+/** Counts ngrams within a single chunk. Ngram bytes are stored once
+    in a bump arena and indexed by an open-addressing hash table. */
+class NGramTable
+{
+ public:
+  struct Entry
+  {
+    uint32_t hash;   // folded hash of the ngram
+    uint32_t length; // ngram length in bytes
+    uint64_t offset; // arena block (high 32 bits) and position (low 32 bits)
+    long count;      // 0 marks an empty slot
+  };
+
+ private:
+  std::vector<Entry> slots;
+  size_t mask;
+  size_t used;
+  bool sorted;
+  size_t maxBytes; // the table only grows past this if it has to
+  bool full;
+
+  std::vector<char*> blocks; // arena blocks, reused across chunks
+  std::vector<size_t> blockSizes;
+  size_t block; // block currently being filled
+  size_t blockPos;
+  size_t arenaBytes; // allocated
+  size_t arenaUsed;  // allocated and in use by the current ngrams
+  size_t peakBytes;  // most bytes() has ever been
+
+  uint64_t store(const char* key, size_t length);
+  void grow();
+
+ public:
+  NGramTable();
+  ~NGramTable();
+
+  /** Adds count occurrences of the given ngram */
+  void add(const char* key, size_t length, long count = 1)
+  {
+    add(key, length, hashNGram(key, length), count);
+  }
+
+  /** Same as above, for an ngram whose hashNGram() is already known */
+  void add(const char* key, size_t length, uint64_t hash, long count);
+
+  /** Sorts entries by ngram. Afterwards entries can be accessed by
+      index, but no more ngrams can be added until clear(). */
+  void sort();
+
+  /** Rewrites each key in place with rewrite(key, length), e.g. into
+      a form which sorts correctly with memcmp(). Afterwards no more
+      ngrams can be added until clear(). */
+  template<class Rewrite> void rewriteKeys(Rewrite rewrite)
+  {
+    for(size_t i=0; i<slots.size(); i++) {
+      const Entry& entry = slots[i];
+      if(entry.count != 0)
+        rewrite(blocks[entry.offset >> 32] + (entry.offset & 0xffffffffULL), entry.length);
+    }
+    sorted = true;
+  }
+
+  /** Removes all ngrams, keeping allocated memory for reuse */
+  void clear();
+
+  /** Exchanges the contents of two tables */
+  void swap(NGramTable& other);
+
+  /** Number of distinct ngrams */
+  size_t size() const { return used; }
+
+  /** Bytes held by the table and its arena, including arena blocks
+      kept for reuse */
+  size_t bytes() const { return slots.size()*sizeof(Entry) + arenaBytes; }
+
+  /** The most bytes the table has ever held. Memory beyond maxBytes
+      is given back when the table is cleared. */
+  size_t peak() const { return peakBytes; }
+
+  /** Bytes an empty table holds: its initial slots and one arena
+      block. No budget keeps a table smaller than this. */
+  static size_t minBytes();
+
+  /** Whether length more bytes of ngrams can be added without the
+      table and its arena growing past maxBytes */
+  bool fits(size_t length) const;
+
+  /** Stops the table from growing if that would take it over
+      maxBytes. Instead it becomes full, see isFull(), and should be
+      cleared. */
+  void setMaxBytes(size_t maxBytes) { this->maxBytes = maxBytes; }
+
+  /** True if the table needs to grow, but growing would take it over
+      its maximum size */
+  bool isFull() const { return full; }
+
+  const Entry& operator[] (const size_t index) const { return slots[index]; }
+
+  const char* key(const Entry& entry) const
+  {
+    return blocks[entry.offset >> 32] + (entry.offset & 0xffffffffULL);
+  }
+};
+
+/** Reads the counts of a sorted table in order */
+class TableCountReader : public CountReader
+{
+ private:
+  const NGramTable* table;
+  size_t index;
+
+ public:
+  TableCountReader(const NGramTable* table) : table(table), index(0) { }
+  void rewind() { index = 0; }
+
+  bool next()
+  {
+    if(index >= table->size())
+      return false;
+
+    const NGramTable::Entry& entry = (*table)[index++];
+    currentKey = table->key(entry);
+    currentLength = entry.length;
+    currentCount = entry.count;
+    return true;
+  }
+};
+
+#endif // NGramTable_h
@@ -0,0 +1,315 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Sort.cpp: sorts ngram counts by descending count, and ngrams with
+              equal counts alphabetically. The total on the first
+              line of input is copied to the output as it is.
+
+              Counts are read into runs of a bounded size. Each full
+              run is sorted by a background thread and spilled to a
+              temporary file in the binary chunk format, while the
+              next run is being read. The sorted runs are then merged
+              in a single k-way pass. Input which fits into a single
+              run is sorted in memory and never written to disk.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include "CountStream.h"
+#include "ChunkFile.h"
+#include "LoserTree.h"
+#include "TopCounts.h"
+#include "utilities.h"
+
+using namespace std;
+
+/// Counts read in one go, sorted and spilled together
+class Run
+{
+ private:
+  struct Record
+  {
+    long count;
+    size_t offset; // of the key within keys
+    size_t length;
+  };
+
+  string keys;
+  vector<Record> records;
+
+ public:
+  void add(const char* key, size_t length, long count)
+  {
+    Record record = { count, keys.size(), length };
+    keys.append(key, length);
+    records.push_back(record);
+  }
+
+  size_t bytes() const { return keys.size() + records.size()*sizeof(Record); }
+
+  void sort()
+  {
+    const char* data = keys.data();
+    std::sort(records.begin(), records.end(), [data](const Record& a, const Record& b) {
+        return frequentFirst(a.count, data + a.offset, a.length,
+                             b.count, data + b.offset, b.length);
+      });
+  }
+
+  void write(CountWriter& out) const
+  {
+    for(size_t i=0; i<records.size(); i++)
+      out.write(keys.data() + records[i].offset, records[i].length, records[i].count);
+    out.close();
+  }
+};
+
+/// Orders count readers most frequent first
+struct FrequentFirst
+{
+  vector<CountReader*>* sources;
+
+  FrequentFirst(vector<CountReader*>* sources) : sources(sources) { }
+
+  bool operator() (size_t a, size_t b) const
+  {
+    CountReader* r1 = (*sources)[a];
+    CountReader* r2 = (*sources)[b];
+    return frequentFirst(r1->count(), r1->key(), r1->keyLength(),
+                         r2->count(), r2->key(), r2->keyLength());
+  }
+};
+
+/// Merges runs sorted most frequent first into out, and closes them
+void mergeRuns(vector<FILE*>& runs, CountWriter& out)
+{
+  vector<CountReader*> sources;
+  vector<bool> hasMore;
+  for(size_t i=0; i<runs.size(); i++) {
+    rewind(runs[i]);
+    sources.push_back(new ChunkReader(runs[i]));
+    hasMore.push_back(sources.back()->next());
+  }
+
+  LoserTree<FrequentFirst> tree(sources.size(), FrequentFirst(&sources));
+  tree.start(hasMore);
+  while(!tree.done()) {
+    CountReader* src = sources[tree.winner()];
+    out.write(src->key(), src->keyLength(), src->count());
+    tree.next(src->next());
+  }
+  out.close();
+
+  for(size_t i=0; i<runs.size(); i++) {
+    delete sources[i];
+    fclose(runs[i]);
+  }
+}
+
+class CountSorter
+{
+ private:
+  size_t runBytes; // maximum size of a run
+  size_t threads;  // runs sorted at once
+  size_t fanIn;    // maximum number of runs merged at once
+  Run* run;        // being read
+  deque<boost::thread*> sorting;
+  vector<FILE*> runs; // sorted and spilled
+  boost::mutex mutex;
+  string error;
+
+  /// Sorts a run and spills it, in the background
+  void spill(Run* run, size_t index)
+  {
+    try {
+      run->sort();
+      FILE* file = tmpfile();
+      if(file == NULL)
+        throw string("Could not create a temporary file for sorted counts.");
+      ChunkWriter writer(file);
+      run->write(writer);
+
+      boost::lock_guard<boost::mutex> lock(mutex);
+      runs[index] = file;
+    } catch(string err) {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      error = err;
+    }
+    delete run;
+  }
+
+  /// Waits for the oldest run being sorted
+  void join()
+  {
+    sorting.front()->join();
+    delete sorting.front();
+    sorting.pop_front();
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if(!error.empty())
+      throw error;
+  }
+
+ public:
+  CountSorter(size_t maxBytes, size_t threads, size_t fanIn)
+  {
+    // one run is read while the others are sorted
+    this->runBytes = maxBytes / (threads + 1);
+    this->threads = threads;
+    this->fanIn = fanIn;
+    this->run = new Run();
+  }
+
+  ~CountSorter()
+  {
+    while(!sorting.empty()) {
+      sorting.front()->join();
+      delete sorting.front();
+      sorting.pop_front();
+    }
+    delete run;
+    for(size_t i=0; i<runs.size(); i++) {
+      if(runs[i] != NULL)
+        fclose(runs[i]);
+    }
+  }
+
+  void add(const char* key, size_t length, long count)
+  {
+    run->add(key, length, count);
+    if(run->bytes() < runBytes)
+      return;
+
+    if(sorting.size() >= threads)
+      join();
+    runs.push_back(NULL);
+    sorting.push_back(new boost::thread(&CountSorter::spill, this, run, runs.size()-1));
+    run = new Run();
+  }
+
+  /// Writes out all counts, most frequent first
+  void close(CountWriter& out)
+  {
+    if(runs.empty()) {
+      run->sort();
+      run->write(out);
+      return;
+    }
+
+    if(sorting.size() >= threads)
+      join();
+    runs.push_back(NULL);
+    sorting.push_back(new boost::thread(&CountSorter::spill, this, run, runs.size()-1));
+    run = NULL;
+    while(!sorting.empty())
+      join();
+
+    // merge the oldest runs until few enough are left for a single
+    // pass
+    while(runs.size() > fanIn) {
+      vector<FILE*> merging(runs.begin(), runs.begin() + fanIn);
+      runs.erase(runs.begin(), runs.begin() + fanIn);
+      FILE* merged = tmpfile();
+      if(merged == NULL)
+        throw string("Could not create a temporary file for sorted counts.");
+      ChunkWriter writer(merged);
+      mergeRuns(merging, writer);
+      runs.push_back(merged);
+    }
+
+    vector<FILE*> merging;
+    merging.swap(runs);
+    mergeRuns(merging, out);
+  }
+};
+
+void printUsage(const char* name)
+{
+  printf("Usage: %s [-m LIMIT] [-j THREADS] [-nt]\n", name);
+}
+
+int main(int argc, const char** argv)
+{
+  size_t maxBytes = 500*1024*1024;
+  int threads = 1;
+  bool hasTotal = true;
+
+  for(int i=1; i<argc; i++) {
+    if(strcmp("-m", argv[i]) == 0 && i<argc-1) {
+      if(!parseSize(argv[i+1], maxBytes)) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      i++;
+    }
+    else if(strcmp("-j", argv[i]) == 0 && i<argc-1) {
+      threads = atoi(argv[i+1]);
+      i++;
+    }
+    else if(strcmp("-nt", argv[i]) == 0) {
+      hasTotal = false;
+    }
+    else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(threads <= 0) {
+    cerr << "Invalid number of threads: " << threads << endl;
+    return 1;
+  }
+
+  try {
+    if(hasTotal) {
+      long total;
+      int next = scanf("%ld", &total) == 1 ? getchar() : EOF;
+      if(next == '\r')
+        next = getchar();
+      if(next != '\n')
+        throw string("Could not read the total count on the first line.");
+      printf("%ld\n", total);
+    }
+
+    CountSorter sorter(maxBytes, threads, min((size_t)128, maxOpenFiles()));
+    TextCountReader reader(stdin);
+    while(reader.next())
+      sorter.add(reader.key(), reader.keyLength(), reader.count());
+
+    TextCountWriter writer(stdout);
+    sorter.close(writer);
+  } catch(string err) {
+    cerr << err << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    SpaceSaving.cpp: the Space-Saving algorithm (Metwally et al., 2005),
+                     which NGramCounter uses to approximately count
+                     frequent ngrams in a fixed amount of memory. Each
+                     of the capacity counters tracks one ngram. When an
+                     untracked ngram arrives and all counters are taken,
+                     it replaces the ngram with the smallest count and
+                     inherits that count as its error. Every ngram
+                     occurring more than total/capacity times is
+                     guaranteed to be tracked, and each reported count
+                     overestimates the true one by at most its error.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "SpaceSaving.h"
+
+using namespace std;
+
+SpaceSaving::SpaceSaving(size_t capacity) {
+  this->capacity = capacity;
+  counters.reserve(capacity);
+  heap.reserve(capacity);
+
+  // keep the index at most half full
+  size_t numSlots = 1024;
+  while(numSlots < 2*capacity)
+    numSlots *= 2;
+  this->slots.resize(numSlots, 0);
+  this->mask = numSlots - 1;
+}
+
+size_t SpaceSaving::bytes() const
+{
+  size_t keyBytes = 0;
+  for(size_t i=0; i<counters.size(); i++)
+    keyBytes += counters[i].key.capacity();
+  return keyBytes + counters.capacity()*sizeof(Counter)
+    + heap.capacity()*sizeof(uint32_t) + slots.size()*sizeof(uint32_t);
+}
+
+/// Returns the slot holding an ngram, or the empty slot where it
+/// would go
+size_t SpaceSaving::find(const char* key, size_t length, uint64_t hash) const
+{
+  size_t pos = hash & mask;
+  while(slots[pos] != 0) {
+    const Counter& counter = counters[slots[pos] - 1];
+    if(counter.hash == hash && counter.key.size() == length
+       && memcmp(counter.key.data(), key, length) == 0)
+      break;
+    pos = (pos + 1) & mask;
+  }
+  return pos;
+}
+
+void SpaceSaving::insertSlot(uint32_t index)
+{
+  const Counter& counter = counters[index];
+  slots[find(counter.key.data(), counter.key.size(), counter.hash)] = index + 1;
+}
+
+/// Removes a counter from the index. Entries following it are shifted
+/// back, so that no probe sequence is broken.
+void SpaceSaving::removeSlot(uint32_t index)
+{
+  const Counter& counter = counters[index];
+  size_t pos = find(counter.key.data(), counter.key.size(), counter.hash);
+  slots[pos] = 0;
+
+  size_t next = (pos + 1) & mask;
+  while(slots[next] != 0) {
+    size_t home = counters[slots[next] - 1].hash & mask;
+    // move the entry to the hole unless its home lies cyclically
+    // within (pos, next]
+    if(((next - home) & mask) >= ((next - pos) & mask)) {
+      slots[pos] = slots[next];
+      slots[next] = 0;
+      pos = next;
+    }
+    next = (next + 1) & mask;
+  }
+}
+
+/// Restores the heap order after the count at pos has grown
+void SpaceSaving::siftDown(size_t pos)
+{
+  const uint32_t index = heap[pos];
+  const long count = counters[index].count;
+  while(true) {
+    size_t child = 2*pos + 1;
+    if(child >= heap.size())
+      break;
+    if(child+1 < heap.size() && counters[heap[child+1]].count < counters[heap[child]].count)
+      child++;
+    if(counters[heap[child]].count >= count)
+      break;
+
+    heap[pos] = heap[child];
+    counters[heap[pos]].heapPos = pos;
+    pos = child;
+  }
+  heap[pos] = index;
+  counters[index].heapPos = pos;
+}
+
+/// Restores the heap order after adding a counter at pos
+void SpaceSaving::siftUp(size_t pos)
+{
+  const uint32_t index = heap[pos];
+  const long count = counters[index].count;
+  while(pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if(counters[heap[parent]].count <= count)
+      break;
+
+    heap[pos] = heap[parent];
+    counters[heap[pos]].heapPos = pos;
+    pos = parent;
+  }
+  heap[pos] = index;
+  counters[index].heapPos = pos;
+}
+
+void SpaceSaving::add(const char* key, size_t length, uint64_t hash)
+{
+  size_t pos = find(key, length, hash);
+  if(slots[pos] != 0) {
+    Counter& counter = counters[slots[pos] - 1];
+    counter.count++;
+    siftDown(counter.heapPos);
+    return;
+  }
+
+  if(counters.size() < capacity) {
+    // a free counter
+    counters.push_back(Counter());
+    Counter& counter = counters.back();
+    counter.key.assign(key, length);
+    counter.hash = hash;
+    counter.count = 1;
+    counter.error = 0;
+    slots[pos] = counters.size();
+
+    heap.push_back(counters.size() - 1);
+    siftUp(heap.size() - 1);
+    return;
+  }
+
+  // replace the ngram with the smallest count
+  const uint32_t index = heap[0];
+  removeSlot(index);
+  Counter& counter = counters[index];
+  counter.key.assign(key, length);
+  counter.hash = hash;
+  counter.error = counter.count;
+  counter.count++;
+  insertSlot(index);
+  siftDown(0);
+}
@@ -0,0 +1,74 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    SpaceSaving.h: see SpaceSaving.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SpaceSaving_h
+#define SpaceSaving_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Approximately counts the most frequent ngrams of a stream using a
+    fixed number of counters. */
+class SpaceSaving
+{
+ public:
+  struct Counter
+  {
+    std::string key;
+    uint64_t hash;
+    long count; // an upper bound on the true count
+    long error; // count minus error is a lower bound
+    uint32_t heapPos;
+  };
+
+ private:
+  std::vector<Counter> counters;
+  std::vector<uint32_t> heap;  // counter indices, smallest count first
+  std::vector<uint32_t> slots; // open-addressing index: counter index+1, or 0
+  size_t mask;
+  size_t capacity;
+
+  void siftUp(size_t pos);
+  void siftDown(size_t pos);
+  size_t find(const char* key, size_t length, uint64_t hash) const;
+  void insertSlot(uint32_t index);
+  void removeSlot(uint32_t index);
+
+ public:
+  SpaceSaving(size_t capacity);
+
+  /** Counts one occurrence of an ngram */
+  void add(const char* key, size_t length, uint64_t hash);
+
+  /** Number of ngrams currently tracked */
+  size_t size() const { return counters.size(); }
+
+  /** Bytes held by the counters */
+  size_t bytes() const;
+
+  const Counter& operator[] (const size_t index) const { return counters[index]; }
+};
+
+#endif // SpaceSaving_h
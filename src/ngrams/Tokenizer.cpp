@@ -35,6 +35,7 @@
 #include <string>
 
 #include "PCREMatcher.h"
+#include "LineIO.h"
 #include "utilities.h"
 
 #define PUNCTUATION ".,!?()&@()[]{}/\\\"'#:;<>^”*=-−—\x93"
@@ -49,6 +50,7 @@ private:
   bool downcase;
   char lastChar;
   PCREMatcher* abbreviationMatcher;  
+  LineWriter& out;
   
   inline bool isPunctuation(char ch) 
   {
@@ -76,14 +78,14 @@ private:
   inline void printSpace()
   {
     if(!isWS(lastChar)) {
-      fputc(' ', stdout);
+      out.put(' ');
       lastChar = ' ';
     }
   }
 
   inline void printChar(char ch)
   {
-    fputc(ch, stdout);
+    out.put(ch);
     lastChar = ch;
    }
   
@@ -98,7 +100,7 @@ private:
   }
 
 public:
-  Tokenizer(const char* keep, bool includeParens, bool downcase) {
+  Tokenizer(const char* keep, bool includeParens, bool downcase, LineWriter& out) : out(out) {
     this->keep = keep;
     this->includeParens = includeParens;
     this->downcase = downcase;
@@ -110,11 +112,11 @@ public:
     delete abbreviationMatcher;
   }
 
-  void tokenize(string& input) {
+  void tokenize(const char* input, size_t length) {
     int parenLevel = 0;
-    for(size_t i=0; i < input.length(); i++) {
+    for(size_t i=0; i < length; i++) {
       // first check for abbreviations like "U.S."
-      if((i == 0 || isWS(input[i-1])) && abbreviationMatcher->match(&(input.c_str()[i]), input.length()-i)) {
+      if((i == 0 || isWS(input[i-1])) && abbreviationMatcher->match(input + i, length-i)) {
         string& abbrv = (*abbreviationMatcher)[0];
         printString(abbrv);
         i += abbrv.length()-1;
@@ -158,7 +160,7 @@ public:
         else if(isPunctuation(ch)) {
           // don't break words on commas delimiting orders of magnitude
           // in numbers, e.g. 1,000,000
-          if(ch == ',' && isDigit(lastChar) && isDigit(input[i+1]))
+          if(ch == ',' && isDigit(lastChar) && i+1 < length && isDigit(input[i+1]))
             printChar(ch);
           else
             printSpace();
@@ -200,13 +202,17 @@ int main(int argc, const char** argv)
     }
   }
 
-  Tokenizer tokenizer(keep, includeParens, downcase);
-
-  string line;
   try {
-    while(getline(cin, line)) {
-      tokenizer.tokenize(line);
+    LineReader input(0);
+    LineWriter output(stdout);
+    Tokenizer tokenizer(keep, includeParens, downcase, output);
+
+    const char* line;
+    size_t length;
+    while(input.next(line, length)) {
+      tokenizer.tokenize(line, length);
     }
+    output.flush();
   } catch(string err) {
     cerr << err << endl;
     return 1;
@@ -0,0 +1,287 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Vocabulary.cpp: maps words to 32-bit IDs, so that NGramCounter can
+                    count ngrams as fixed-width tuples of IDs and only
+                    turn them back into strings when writing sorted
+                    output. The IDs of <s> and </s> are fixed.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <algorithm>
+#include "Vocabulary.h"
+#include "NGramTable.h"
+
+using namespace std;
+
+const uint32_t NO_ID = 0xffffffff;
+const size_t PAGE_SIZE = 1 << 16; // words per page
+const size_t MAX_PAGES = 1 << 16;
+const size_t ARENA_BLOCK_SIZE = 1024*1024;
+
+Vocabulary::Vocabulary() {
+  this->pages.resize(MAX_PAGES, NULL);
+  this->arenaPos = ARENA_BLOCK_SIZE;
+  this->arenaBytes = 0;
+  this->slots.resize(1 << 16, 0);
+  this->mask = this->slots.size() - 1;
+  this->used = 0;
+
+  insert("<s>", 3, hashNGram("<s>", 3));
+  insert("</s>", 4, hashNGram("</s>", 4));
+}
+
+Vocabulary::~Vocabulary()
+{
+  for(size_t i=0; i<pages.size(); i++)
+    delete[] pages[i];
+  for(size_t i=0; i<arena.size(); i++)
+    delete[] arena[i];
+}
+
+size_t Vocabulary::bytes() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(mutex);
+  size_t numPages = (used + PAGE_SIZE - 1) / PAGE_SIZE;
+  return arenaBytes + slots.size()*sizeof(uint32_t)
+    + pages.size()*sizeof(Word*) + numPages*PAGE_SIZE*sizeof(Word);
+}
+
+uint32_t Vocabulary::find(const char* word, size_t length, uint64_t hash) const
+{
+  size_t pos = hash & mask;
+  while(slots[pos] != 0) {
+    uint32_t id = slots[pos] - 1;
+    size_t idLength;
+    const char* bytes = this->word(id, idLength);
+    if(idLength == length && memcmp(bytes, word, length) == 0)
+      return id;
+    pos = (pos + 1) & mask;
+  }
+  return NO_ID;
+}
+
+/// Adds a word unless it's already known. Must be called with the
+/// lock held exclusively.
+uint32_t Vocabulary::insert(const char* word, size_t length, uint64_t hash)
+{
+  uint32_t id = find(word, length, hash);
+  if(id != NO_ID)
+    return id;
+
+  if(used == NO_ID)
+    throw string("Vocabulary too large: more than 2^32 distinct words.");
+
+  // copy the word to the arena
+  if(arenaPos + length > ARENA_BLOCK_SIZE || arena.empty()) {
+    size_t size = max(ARENA_BLOCK_SIZE, length);
+    arena.push_back(new char[size]);
+    arenaBytes += size;
+    arenaPos = 0;
+  }
+  char* bytes = arena.back() + arenaPos;
+  memcpy(bytes, word, length);
+  arenaPos = (length > ARENA_BLOCK_SIZE) ? ARENA_BLOCK_SIZE : arenaPos + length;
+
+  id = used;
+  if(pages[id / PAGE_SIZE] == NULL)
+    pages[id / PAGE_SIZE] = new Word[PAGE_SIZE];
+  Word& w = pages[id / PAGE_SIZE][id % PAGE_SIZE];
+  w.bytes = bytes;
+  w.length = length;
+
+  size_t pos = hash & mask;
+  while(slots[pos] != 0)
+    pos = (pos + 1) & mask;
+  slots[pos] = id + 1;
+  used++;
+
+  if(used*2 >= slots.size())
+    grow();
+  return id;
+}
+
+void Vocabulary::grow()
+{
+  vector<uint32_t> old(slots.size()*2, 0);
+  old.swap(slots);
+  mask = slots.size() - 1;
+
+  for(size_t i=0; i<old.size(); i++) {
+    if(old[i] == 0)
+      continue;
+
+    size_t length;
+    const char* bytes = word(old[i] - 1, length);
+    size_t pos = hashNGram(bytes, length) & mask;
+    while(slots[pos] != 0)
+      pos = (pos + 1) & mask;
+    slots[pos] = old[i];
+  }
+}
+
+void Vocabulary::lookup(const char* line, const vector<WordSpan>& words,
+                        vector<uint32_t>& ids)
+{
+  const size_t start = ids.size();
+  size_t missing = 0;
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    for(size_t i=0; i<words.size(); i++) {
+      const char* word = line + words[i].first;
+      uint32_t id = find(word, words[i].second, hashNGram(word, words[i].second));
+      ids.push_back(id);
+      missing += (id == NO_ID);
+    }
+  }
+
+  if(missing == 0)
+    return;
+
+  // new words are rare once the vocabulary has warmed up, so they're
+  // added under a separate, exclusive lock
+  boost::unique_lock<boost::shared_mutex> lock(mutex);
+  for(size_t i=0; i<words.size(); i++) {
+    if(ids[start+i] != NO_ID)
+      continue;
+    const char* word = line + words[i].first;
+    ids[start+i] = insert(word, words[i].second, hashNGram(word, words[i].second));
+  }
+}
+
+/// Reads the i-th 32-bit number of a (possibly unaligned) tuple
+inline uint32_t tupleAt(const char* tuple, size_t i)
+{
+  uint32_t x;
+  memcpy(&x, tuple + i*sizeof(uint32_t), sizeof(uint32_t));
+  return x;
+}
+
+void Vocabulary::join(const char* ids, size_t n, string& out) const
+{
+  for(size_t i=0; i<n; i++) {
+    if(i > 0)
+      out.push_back(' ');
+    size_t length;
+    const char* bytes = word(tupleAt(ids, i), length);
+    out.append(bytes, length);
+  }
+}
+
+void Vocabulary::order(WordOrder& order)
+{
+  size_t size;
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    size = used;
+  }
+
+  // last words compare on their own, the others as if followed by a
+  // space. The two orders only differ for words with characters
+  // below ' '.
+  vector<uint32_t>& lastWords = order.lastWords;
+  lastWords.resize(size);
+  for(uint32_t id=0; id<size; id++)
+    lastWords[id] = id;
+  order.midWords = lastWords;
+
+  std::sort(lastWords.begin(), lastWords.end(), [this](uint32_t a, uint32_t b) {
+      size_t lengthA, lengthB;
+      const char* wordA = word(a, lengthA);
+      const char* wordB = word(b, lengthB);
+      int cmp = memcmp(wordA, wordB, min(lengthA, lengthB));
+      return cmp < 0 || (cmp == 0 && lengthA < lengthB);
+    });
+
+  std::sort(order.midWords.begin(), order.midWords.end(), [this](uint32_t a, uint32_t b) {
+      size_t lengthA, lengthB;
+      const unsigned char* wordA = (const unsigned char*)word(a, lengthA);
+      const unsigned char* wordB = (const unsigned char*)word(b, lengthB);
+      int cmp = memcmp(wordA, wordB, min(lengthA, lengthB));
+      if(cmp != 0)
+        return cmp < 0;
+      else if(lengthA < lengthB)
+        return ' ' < wordB[lengthA];
+      else
+        return lengthA != lengthB && wordA[lengthB] < ' ';
+    });
+
+  order.midRanks.resize(size);
+  order.lastRanks.resize(size);
+  for(uint32_t rank=0; rank<size; rank++) {
+    order.midRanks[order.midWords[rank]] = rank;
+    order.lastRanks[lastWords[rank]] = rank;
+  }
+}
+
+void WordOrder::encode(char* ids, size_t n) const
+{
+  for(size_t i=0; i<n; i++) {
+    uint32_t id = tupleAt(ids, i);
+    uint32_t rank = (i == n-1) ? lastRanks[id] : midRanks[id];
+    unsigned char* bytes = (unsigned char*)ids + i*sizeof(uint32_t);
+    bytes[0] = rank >> 24;
+    bytes[1] = rank >> 16;
+    bytes[2] = rank >> 8;
+    bytes[3] = rank;
+  }
+}
+
+uint32_t WordOrder::word(const char* ranks, size_t i, size_t n) const
+{
+  const unsigned char* bytes = (const unsigned char*)ranks + i*sizeof(uint32_t);
+  uint32_t rank = ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+  return (i == n-1) ? lastWords[rank] : midWords[rank];
+}
+
+const string& TupleJoiner::join(const char* key, size_t length)
+{
+  const char* ranks = key + headerLength;
+  const size_t n = (length - headerLength) / sizeof(uint32_t);
+
+  // keep the words of the longest common prefix with the last tuple,
+  // except for its last word, which is ranked differently
+  size_t shared = 0;
+  if(lastKey.size() == length && memcmp(key, lastKey.data(), headerLength) == 0) {
+    const char* lastRanks = lastKey.data() + headerLength;
+    while(shared < n-1 && memcmp(ranks + shared*sizeof(uint32_t),
+                                 lastRanks + shared*sizeof(uint32_t),
+                                 sizeof(uint32_t)) == 0)
+      shared++;
+  }
+
+  if(shared > 0)
+    joined.resize(ends[shared-1]);
+  else
+    joined.assign(key, headerLength);
+  ends.resize(shared);
+  for(size_t i=shared; i<n; i++) {
+    if(i > 0)
+      joined.push_back(' ');
+    size_t wordLength;
+    const char* word = vocabulary.word(order.word(ranks, i, n), wordLength);
+    joined.append(word, wordLength);
+    ends.push_back(joined.size());
+  }
+
+  lastKey.assign(key, length);
+  return joined;
+}
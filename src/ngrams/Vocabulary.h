@@ -0,0 +1,146 @@
+/*
+    AutoCorpus: automatically extracts clean natural language corpora from
+    publicly available datasets.
+
+    Vocabulary.h: see Vocabulary.cpp for a description.
+
+
+
+    Copyright (C) 2011 Maciej Pacula
+
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef Vocabulary_h
+#define Vocabulary_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#define START_WORD_ID 0 // <s>
+#define END_WORD_ID 1   // </s>
+
+/** Hashes a tuple of word IDs */
+inline uint64_t hashWordIds(const uint32_t* ids, size_t n)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+  for(size_t i=0; i<n; i++) {
+    h = (h ^ ids[i]) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+/** A word (start, length) within a line */
+typedef std::pair<size_t, size_t> WordSpan;
+
+class Vocabulary;
+
+/** The sort order of the words of a vocabulary. Tuples of word ranks
+    compare like the space-joined words of the tuples do: all but the
+    last word of a tuple are ranked as if followed by a space. */
+struct WordOrder
+{
+  std::vector<uint32_t> midRanks;  // by word ID
+  std::vector<uint32_t> lastRanks;
+  std::vector<uint32_t> midWords;  // word IDs by rank
+  std::vector<uint32_t> lastWords;
+
+  /** Rewrites a tuple of n word IDs in place as big-endian ranks, so
+      that tuples can be sorted with memcmp() */
+  void encode(char* ids, size_t n) const;
+
+  /** Returns the word ID at position i of an encoded tuple */
+  uint32_t word(const char* ranks, size_t i, size_t n) const;
+};
+
+/** Turns sorted, encoded tuples back into space-separated words.
+    Each tuple may start with a header of headerLength bytes, which is
+    copied verbatim. Words shared with the previous tuple are not
+    looked up again. */
+class TupleJoiner
+{
+ private:
+  const Vocabulary& vocabulary;
+  const WordOrder& order;
+  size_t headerLength;
+  std::string joined;
+  std::string lastKey;
+  std::vector<size_t> ends; // end of each word within joined
+
+ public:
+  TupleJoiner(const Vocabulary& vocabulary, const WordOrder& order, size_t headerLength = 0)
+    : vocabulary(vocabulary), order(order), headerLength(headerLength) { }
+
+  const std::string& join(const char* key, size_t length);
+};
+
+/** Interns words as 32-bit IDs. Can be shared between threads. */
+class Vocabulary
+{
+ private:
+  struct Word
+  {
+    const char* bytes;
+    uint32_t length;
+  };
+
+  // words are stored in fixed-size pages which never move, so that
+  // words of known IDs can be read without locking
+  std::vector<Word*> pages;
+  std::vector<char*> arena;
+  size_t arenaPos;
+  size_t arenaBytes;
+
+  std::vector<uint32_t> slots; // open-addressing index: ID+1, or 0 if empty
+  size_t mask;
+  uint32_t used;
+  mutable boost::shared_mutex mutex;
+
+  uint32_t find(const char* word, size_t length, uint64_t hash) const;
+  uint32_t insert(const char* word, size_t length, uint64_t hash);
+  void grow();
+
+ public:
+  Vocabulary();
+  ~Vocabulary();
+
+  /** Looks up (and adds if necessary) the IDs of the given words of
+      a line, appending them to ids. */
+  void lookup(const char* line, const std::vector<WordSpan>& words,
+              std::vector<uint32_t>& ids);
+
+  const char* word(uint32_t id, size_t& length) const
+  {
+    const Word& w = pages[id >> 16][id & 0xffff];
+    length = w.length;
+    return w.bytes;
+  }
+
+  /** Number of distinct words */
+  size_t size() const { return used; }
+
+  /** Bytes held by the vocabulary */
+  size_t bytes() const;
+
+  /** Appends the space-separated words of a tuple of n IDs to out */
+  void join(const char* ids, size_t n, std::string& out) const;
+
+  /** Computes the sort order of all words added so far */
+  void order(WordOrder& order);
+};
+
+#endif // Vocabulary_h
@@ -25,10 +25,25 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 """
 
+import os
 import sys
+import shutil
 import subprocess
+import tempfile
 from optparse import OptionParser
 
+# inputs shared by many tests. Each is generated once into a temporary
+# directory, and its path passed to the tests in the named environment
+# variable.
+FIXTURES = [
+    # 100000 lines with 112697 distinct bigrams
+    ("CORPUS", "seq 1 100000 | awk '{print $1%1009, $1%997, $1%13}'"),
+    # 50000 lines of keys with long shared prefixes, some longer than 127
+    # bytes
+    ("LONG_KEYS", "seq 1 50000 | awk 'BEGIN {for(i=0; i<9; i++) z = z z \"xyz\"} "
+                  "{print \"common\" $1%2003, substr(z, 1, $1%400) $1%31}'"),
+]
+
 # poor man's check_output for python < 2.7
 def execute(cmd):
      process = subprocess.Popen(cmd, stdout=subprocess.PIPE, shell=True)
@@ -45,6 +60,12 @@ def stripLines(text):
         output += line.strip() + '\n'
     return output
 
+def makeFixtures(directory):
+    for name, command in FIXTURES:
+        path = os.path.join(directory, name.lower())
+        execute(command + " > " + path)
+        os.environ[name] = path
+
 def performTest(command, expectedOutput):
     print "> " + command
     output = execute(command)
@@ -67,6 +88,8 @@ if __name__ == "__main__":
     exit(1)
 
   f = open(args[0], 'r')
+  fixtures = tempfile.mkdtemp()
+  makeFixtures(fixtures)
 
   command = None
   expectedOutput = ""
@@ -93,6 +116,7 @@ if __name__ == "__main__":
        failedTests += 0 if success else 1      
         
   f.close()
+  shutil.rmtree(fixtures)
   print "----------------------------"
   print "%-20s %d\n%-20s %d\n%-20s %d" % ("TESTS RUN:", totalTests,
                                  "TESTS PASSED: ", totalTests - failedTests,
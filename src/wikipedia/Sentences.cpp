@@ -29,6 +29,7 @@
 #include <string>
 
 #include "SentenceExtractor.h"
+#include "LineIO.h"
 
 using namespace std;
 
@@ -43,24 +44,26 @@ int main(int argc, char** argv)
   opts.separateParagraphs = true;
   SentenceExtractor extractor(opts);
   string input;
-  string line;
-  while(getline(cin, line)) {
-    if(line == "\f") {
-        string output = extractor.extract(input.c_str());
-        cout << output << endl;
-        cout << "\f" << endl;
+  const char* line;
+  size_t length;
+  LineReader in(0);
+  LineWriter out(stdout);
+  while(in.next(line, length)) {
+    if(length == 1 && line[0] == '\f') {
+        out.write(extractor.extract(input.c_str()));
+        out.write("\n\f\n", 3);
         input.clear();
     }
     else {
-      input += line;
+      input.append(line, length);
       input += "\n";
     }
   }  
 
   if(input.length() > 0) {
-    string output = extractor.extract(input.c_str());
-    cout << output << endl;
-    cout << "\f" << endl;
+    out.write(extractor.extract(input.c_str()));
+    out.write("\n\f\n", 3);
     input.clear();
   }
+  out.flush();
 }
@@ -32,6 +32,7 @@
 
 #include "Textifier.h" 
 #include "utilities.h"
+#include "LineIO.h"
 
 using namespace std;
 
@@ -68,11 +69,14 @@ int main(int argc, char** argv)
   }
 
   string input;
-  string line;
+  const char* line;
+  size_t length;
   long article_start_index = 0, line_number = 0;
-  while(getline(cin, line)) {
+  LineReader in(0);
+  LineWriter out(stdout);
+  while(in.next(line, length)) {
     line_number++;
-    if(line == "\f") { // end of article
+    if(length == 1 && line[0] == '\f') { // end of article
       const int markup_len = input.size();
       char* plaintext = new char[2*markup_len+1];
       try {
@@ -82,8 +86,8 @@ int main(int argc, char** argv)
         while(*textStart == '\n' || *textStart == '\r' || *textStart == ' ') {
           textStart++;
         }
-        cout << textStart << endl;
-        cout << '\f' << endl;
+        out.write(textStart, strlen(textStart));
+        out.write("\n\f\n", 3);
       }
       catch(Error err) {
         long line;
@@ -97,10 +101,11 @@ int main(int argc, char** argv)
       article_start_index = line_number+1;
     }
     else {
-      input += line;
+      input.append(line, length);
       input += "\n";
     }
   }
+  out.flush();
 
   return 0;
 }